@@ -4,10 +4,13 @@
 
 #include "ActuationModelDoublePendulum.h"
 
-ActuationModelDoublePendulum::ActuationModelDoublePendulum(const boost::shared_ptr<crocoddyl::StateAbstract> &state,
-                                                           const size_t &nu, size_t nv, actuated_link act_link) : ActuationModelAbstractTpl(state, nu), nv(nv) {
+template<typename Scalar, int NJoints>
+ActuationModelPendulumTpl<Scalar, NJoints>::ActuationModelPendulumTpl(const boost::shared_ptr<StateAbstract> &state,
+                                                           const size_t &nu, size_t nv, actuated_link act_link) : Base(state, nu), nv(nv) {
     this->nv = state->get_nv();
-    S = MathBase::MatrixXs(this->nv, this->nu_);
+    assert(this->nv == NJoints && "The model does not have NJoints joints");
+
+    S = MatrixXs::Zero(this->nv, this->nu_);
     switch(act_link){
  
         case BASE_LINK:
@@ -17,25 +20,64 @@ ActuationModelDoublePendulum::ActuationModelDoublePendulum(const boost::shared_p
         
         case ENDPOINT_LINK:
             std::cout << "Changing to endpoint link actuation mode." << std::endl;
-            S(1,1) = 1;
+            S(NJoints - 1, std::min<long>(NJoints, this->nu_) - 1) = 1;
         break;
  
         default:
         std::cout << "Actuated link selected out of range.Val is " << act_link << std::endl;
         case BOTH_LINKS:
         std::cout << "Changing to both link actuation mode." << std::endl;
-        S(0,0) = 1;
-        S(1,1) = 1;
+        for(long i = 0; i < std::min<long>(NJoints, this->nu_); i++)
+            S(i,i) = 1;
         break;
     }
+
+    S_scaled = S;
+    friction_viscous.setZero();
+    friction_coulomb.setZero();
+    friction_smoothing = Scalar(0.01);
+}
+
+template<typename Scalar, int NJoints>
+void ActuationModelPendulumTpl<Scalar, NJoints>::setFriction(const VectorXs &viscous, const VectorXs &coulomb, Scalar friction_smoothing)
+{
+    friction_viscous = viscous;
+    friction_coulomb = coulomb;
+    this->friction_smoothing = friction_smoothing;
+}
+
+template<typename Scalar, int NJoints>
+void ActuationModelPendulumTpl<Scalar, NJoints>::setTorqueScale(const VectorXs &torque_scale)
+{
+    S_scaled = S * torque_scale.asDiagonal();
 }
 
-void ActuationModelDoublePendulum::calc(const boost::shared_ptr<ActuationDataAbstract> &data, const Eigen::Ref<const VectorXs> &x,
+template<typename Scalar, int NJoints>
+void ActuationModelPendulumTpl<Scalar, NJoints>::calc(const boost::shared_ptr<ActuationDataAbstract> &data, const Eigen::Ref<const VectorXs> &x,
               const Eigen::Ref<const VectorXs> &u) {    
-    data->tau = u * S;
+    data->tau.noalias() = S_scaled * u;
+
+    const VectorNs v = x.template tail<NJoints>();
+    data->tau.array() -= friction_viscous.array() * v.array() + friction_coulomb.array() * (v.array() / friction_smoothing).tanh();
 }
 
-void ActuationModelDoublePendulum::calcDiff(const boost::shared_ptr<ActuationDataAbstract> &data, const Eigen::Ref<const VectorXs> &x,
+template<typename Scalar, int NJoints>
+void ActuationModelPendulumTpl<Scalar, NJoints>::calcDiff(const boost::shared_ptr<ActuationDataAbstract> &data, const Eigen::Ref<const VectorXs> &x,
                   const Eigen::Ref<const VectorXs> &u){
-    data->dtau_du = S;
+    data->dtau_du = S_scaled;
+
+    //d tanh(v / s) / dv = (1 - tanh^2(v / s)) / s
+    const VectorNs v = x.template tail<NJoints>();
+    data->dtau_dx.template rightCols<NJoints>().diagonal() = -(friction_viscous.array()
+        + friction_coulomb.array() * (Scalar(1) - (v.array() / friction_smoothing).tanh().square()) / friction_smoothing).matrix();
 }
+
+template class ActuationModelPendulumTpl<double, 2>;
+template class ActuationModelPendulumTpl<double, 3>;
+template class ActuationModelPendulumTpl<double, 4>;
+template class ActuationModelPendulumTpl<double, 5>;
+
+template class ActuationModelPendulumTpl<float, 2>;
+template class ActuationModelPendulumTpl<float, 3>;
+template class ActuationModelPendulumTpl<float, 4>;
+template class ActuationModelPendulumTpl<float, 5>;
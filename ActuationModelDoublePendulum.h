@@ -29,12 +29,31 @@
 enum actuated_link{
     ENDPOINT_LINK = 0,
     BASE_LINK = 1,
-    BOTH_LINKS = 2
+    BOTH_LINKS = 2  // Every joint of the chain.
 };
 
-class ActuationModelDoublePendulum: public crocoddyl::ActuationModelAbstract {
+// Actuation of a planar chain of NJoints revolute joints with optional friction.
+// NJoints is fixed at compile time so the joint-sized vectors live on the stack.
+// Instantiated for double and float, like the crocoddyl models it plugs into.
+template<typename _Scalar, int NJoints>
+class ActuationModelPendulumTpl: public crocoddyl::ActuationModelAbstractTpl<_Scalar> {
 public:
-    ActuationModelDoublePendulum(const boost::shared_ptr<StateAbstract> &state, const size_t &nu, size_t nv,actuated_link act_link);
+    typedef _Scalar Scalar;
+    typedef crocoddyl::ActuationModelAbstractTpl<Scalar> Base;
+    typedef crocoddyl::MathBaseTpl<Scalar> MathBase;
+    typedef crocoddyl::StateAbstractTpl<Scalar> StateAbstract;
+    typedef crocoddyl::ActuationDataAbstractTpl<Scalar> ActuationDataAbstract;
+    typedef typename MathBase::VectorXs VectorXs;
+    typedef typename MathBase::MatrixXs MatrixXs;
+    typedef Eigen::Matrix<Scalar, NJoints, 1> VectorNs;
+
+    ActuationModelPendulumTpl(const boost::shared_ptr<StateAbstract> &state, const size_t &nu, size_t nv,actuated_link act_link);
+
+    // Joint friction tau_f = -viscous * v - coulomb * tanh(v / friction_smoothing).
+    void setFriction(const VectorXs &viscous, const VectorXs &coulomb, Scalar friction_smoothing);
+
+    // Ratio between the real and the nominal motor torque constant of each input.
+    void setTorqueScale(const VectorXs &torque_scale);
 
 private:
 
@@ -46,8 +65,15 @@ private:
                   const Eigen::Ref<const VectorXs> &u) override;
 
     size_t nv;
-    MathBase::MatrixXs S;
+    MatrixXs S;
+    MatrixXs S_scaled;
+
+    Eigen::Matrix<Scalar, NJoints, 1, Eigen::DontAlign> friction_viscous;
+    Eigen::Matrix<Scalar, NJoints, 1, Eigen::DontAlign> friction_coulomb;
+    Scalar friction_smoothing;
 };
 
+typedef ActuationModelPendulumTpl<double, 2> ActuationModelDoublePendulum;
+
 
 #endif //DoublePENDULUM_ACTUATIONMODELDoublePENDULUM_H
@@ -0,0 +1,160 @@
+#include "AllocationTracker.h"
+
+#include <Eigen/Core>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <malloc.h>
+
+static std::atomic<long> allocation_count(0);
+static std::atomic<long> deallocation_count(0);
+static std::atomic<std::size_t> live_bytes(0);
+static std::atomic<std::size_t> peak_bytes(0);
+static std::atomic<long> worker_allocation_count(0);
+
+//Trivial, so reading it from inside malloc never runs a TLS constructor.
+static thread_local long thread_allocation_count = 0;
+
+#ifdef DOUBLEPENDULUM_TRACK_ALLOCATIONS
+
+//glibc entry points, the wrappers below count and forward to them.
+extern "C" void *__libc_malloc(std::size_t size);
+extern "C" void *__libc_calloc(std::size_t n, std::size_t size);
+extern "C" void *__libc_realloc(void *p, std::size_t size);
+extern "C" void *__libc_memalign(std::size_t alignment, std::size_t size);
+extern "C" void __libc_free(void *p);
+
+static void countAllocation(void *p)
+{
+    if(!p) return;
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    thread_allocation_count++;
+
+    const std::size_t size = malloc_usable_size(p);
+    const std::size_t live = live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    std::size_t peak = peak_bytes.load(std::memory_order_relaxed);
+    while(live > peak && !peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed));
+}
+
+static void countFree(void *p)
+{
+    if(!p) return;
+    deallocation_count.fetch_add(1, std::memory_order_relaxed);
+    live_bytes.fetch_sub(malloc_usable_size(p), std::memory_order_relaxed);
+}
+
+//Hooking malloc instead of operator new also catches Eigen, which allocates with malloc.
+extern "C" void *malloc(std::size_t size)
+{
+    void *p = __libc_malloc(size);
+    countAllocation(p);
+    return p;
+}
+
+extern "C" void *calloc(std::size_t n, std::size_t size)
+{
+    void *p = __libc_calloc(n, size);
+    countAllocation(p);
+    return p;
+}
+
+extern "C" void *realloc(void *p, std::size_t size)
+{
+    countFree(p);
+    void *q = __libc_realloc(p, size);
+    countAllocation(q);
+    return q;
+}
+
+extern "C" void *memalign(std::size_t alignment, std::size_t size)
+{
+    void *p = __libc_memalign(alignment, size);
+    countAllocation(p);
+    return p;
+}
+
+extern "C" void *aligned_alloc(std::size_t alignment, std::size_t size)
+{
+    return memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void **p, std::size_t alignment, std::size_t size)
+{
+    *p = memalign(alignment, size);
+    return *p ? 0 : ENOMEM;
+}
+
+extern "C" void free(void *p)
+{
+    countFree(p);
+    __libc_free(p);
+}
+#endif
+
+bool AllocationTracker::enabled()
+{
+#ifdef DOUBLEPENDULUM_TRACK_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+long AllocationTracker::allocations()
+{
+    return allocation_count.load(std::memory_order_relaxed);
+}
+
+long AllocationTracker::threadAllocations()
+{
+    return thread_allocation_count;
+}
+
+long AllocationTracker::workerAllocations()
+{
+    return worker_allocation_count.load(std::memory_order_relaxed);
+}
+
+void AllocationTracker::addWorkerAllocations(long count)
+{
+    if(count) worker_allocation_count.fetch_add(count, std::memory_order_relaxed);
+}
+
+long AllocationTracker::deallocations()
+{
+    return deallocation_count.load(std::memory_order_relaxed);
+}
+
+std::size_t AllocationTracker::liveBytes()
+{
+    return live_bytes.load(std::memory_order_relaxed);
+}
+
+std::size_t AllocationTracker::peakBytes()
+{
+    return peak_bytes.load(std::memory_order_relaxed);
+}
+
+void AllocationTracker::resetPeak()
+{
+    peak_bytes.store(live_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void AllocationTracker::setEigenMallocAllowed(bool allowed)
+{
+#ifdef EIGEN_RUNTIME_NO_MALLOC
+    Eigen::internal::set_is_malloc_allowed(allowed);
+#else
+    (void)allowed;
+#endif
+}
+
+AllocationScope::AllocationScope() : start(AllocationTracker::threadAllocations()), start_workers(AllocationTracker::workerAllocations())
+{
+}
+
+long AllocationScope::allocations() const
+{
+    return AllocationTracker::threadAllocations() - start + AllocationTracker::workerAllocations() - start_workers;
+}
@@ -0,0 +1,46 @@
+#ifndef DoublePENDULUM_ALLOCATIONTRACKER_H
+#define DoublePENDULUM_ALLOCATIONTRACKER_H
+
+#include <cstddef>
+
+// Counts the heap allocations of the whole process. AllocationTracker.cpp wraps the glibc
+// malloc family, which operator new and Eigen both end up in, only when the target defines
+// DOUBLEPENDULUM_TRACK_ALLOCATIONS. Otherwise nothing is wrapped and every count stays 0.
+class AllocationTracker
+{
+public:
+    static bool enabled();
+
+    static long allocations();
+    // Allocations made by the calling thread.
+    static long threadAllocations();
+    // Allocations made by ThreadPool workers inside their jobs, added when each job ends.
+    static long workerAllocations();
+    static void addWorkerAllocations(long count);
+    static long deallocations();
+
+    // Bytes currently allocated, and the most there ever was.
+    static std::size_t liveBytes();
+    static std::size_t peakBytes();
+    static void resetPeak();
+
+    // Makes Eigen assert on any allocation while disallowed. A no-op unless the build
+    // defines EIGEN_RUNTIME_NO_MALLOC.
+    static void setEigenMallocAllowed(bool allowed);
+};
+
+// Allocations made by the calling thread and by the ThreadPool workers since the scope
+// started, so the MPPI rollouts and the scenario solves of a tick are counted too. Workers of
+// other pools, the telemetry and the config threads are not.
+class AllocationScope
+{
+private:
+    long start;
+    long start_workers;
+
+public:
+    AllocationScope();
+    long allocations() const;
+};
+
+#endif
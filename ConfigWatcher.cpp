@@ -0,0 +1,115 @@
+#include "ConfigWatcher.h"
+
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <iostream>
+
+TunableParameters TunableParameters::fromYAML(const YAML::Node &config)
+{
+    TunableParameters p;
+
+    p.goal_weights << config["Sin_theta_Weight"].as<double>(), config["Sin_alpha_Weight"].as<double>(),
+        config["Cos_theta_Weight"].as<double>(), config["Cos_alpha_Weight"].as<double>(),
+        config["Vel_theta_Weight"].as<double>(), config["Vel_alpha_Weight"].as<double>();
+
+    p.x_reg_weight = config["xReg"].as<double>();
+    p.u_reg_weight = config["uReg"].as<double>();
+
+    p.trajectory_node_weight = config["trajectory_node_weight"].as<double>();
+    p.trajectory_terminal_weight = config["trajectory_terminal_weight"].as<double>();
+
+    p.running_model_goal_weight = config["running_model_goal_weight"].as<double>();
+    p.terminal_model_goal_weight = config["terminal_model_goal_weight"].as<double>();
+
+    p.joint_limit_weight = config["joint_limit_weight"].as<double>(1e3);
+
+    p.tau_ub = config["tau_ub"].as<double>();
+    p.tau_lb = config["tau_lb"].as<double>();
+
+    p.trajectory_solver_iterations = config["initial_solver_iterations"].as<int>();
+    p.mpc_solver_iterations = config["solver_iterations"].as<int>();
+
+    return p;
+}
+
+ConfigWatcher::ConfigWatcher(const std::string &path) : path(path), stopping(false), version(0), taken_version(0)
+{
+    //Editors usually save by renaming a new file over the old one, so watch the directory.
+    std::size_t slash = path.find_last_of('/');
+    directory = slash == std::string::npos ? "." : path.substr(0, slash);
+    file_name = slash == std::string::npos ? path : path.substr(slash + 1);
+
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    watch_fd = inotify_fd < 0 ? -1 : inotify_add_watch(inotify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+
+    if(watch_fd < 0){
+        std::cout << "Could not watch " << path << ", config reload is disabled." << std::endl;
+        return;
+    }
+
+    watch_thread = std::thread(&ConfigWatcher::watchLoop, this);
+    std::cout << "Watching " << path << " for changes." << std::endl;
+}
+
+ConfigWatcher::~ConfigWatcher()
+{
+    stopping = true;
+    if(watch_thread.joinable()) watch_thread.join();
+    if(inotify_fd >= 0) close(inotify_fd);
+}
+
+void ConfigWatcher::watchLoop()
+{
+    alignas(struct inotify_event) char buffer[4096];
+    pollfd fd = {inotify_fd, POLLIN, 0};
+
+    while(!stopping)
+    {
+        //Timeout so the destructor does not wait for a file change.
+        if(::poll(&fd, 1, 200) <= 0) continue;
+
+        bool changed = false;
+        ssize_t length;
+        while((length = read(inotify_fd, buffer, sizeof(buffer))) > 0){
+            for(char *p = buffer; p < buffer + length; ){
+                auto *event = reinterpret_cast<struct inotify_event*>(p);
+                if(event->len > 0 && file_name == event->name) changed = true;
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+
+        if(changed) reload();
+    }
+}
+
+void ConfigWatcher::reload()
+{
+    TunableParameters parameters;
+    try{
+        parameters = TunableParameters::fromYAML(YAML::LoadFile(path));
+    }catch(const std::exception &e){
+        std::cout << "Config reload ignored: " << e.what() << std::endl;
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(staging_mutex);
+        staging = parameters;
+        version++;
+    }
+    std::cout << "Config changed, new parameters will be applied on the next tick." << std::endl;
+}
+
+bool ConfigWatcher::poll(TunableParameters &parameters)
+{
+    if(version.load(std::memory_order_acquire) == taken_version) return false;
+
+    std::unique_lock<std::mutex> lock(staging_mutex, std::try_to_lock);
+    if(!lock.owns_lock()) return false;
+
+    parameters = staging;
+    taken_version = version;
+    return true;
+}
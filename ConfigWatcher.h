@@ -0,0 +1,71 @@
+#ifndef DoublePENDULUM_CONFIGWATCHER_H
+#define DoublePENDULUM_CONFIGWATCHER_H
+
+#include <Eigen/Dense>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "yaml-cpp/yaml.h"
+
+// Config values that can change while the controller runs. Fixed size, so copying
+// it on the control thread never allocates.
+struct TunableParameters
+{
+    Eigen::Matrix<double, 6, 1, Eigen::DontAlign> goal_weights;
+
+    double x_reg_weight;
+    double u_reg_weight;
+
+    double trajectory_node_weight;
+    double trajectory_terminal_weight;
+
+    double running_model_goal_weight;
+    double terminal_model_goal_weight;
+
+    double joint_limit_weight;
+
+    double tau_ub;
+    double tau_lb;
+
+    int trajectory_solver_iterations;
+    int mpc_solver_iterations;
+
+    static TunableParameters fromYAML(const YAML::Node &config);
+};
+
+// Watches the config file with inotify on its own thread. Each change is parsed there
+// and left in a staging copy that the control thread picks up between ticks.
+class ConfigWatcher
+{
+private:
+    std::string path;
+    std::string directory;
+    std::string file_name;
+
+    int inotify_fd;
+    int watch_fd;
+
+    std::thread watch_thread;
+    std::atomic<bool> stopping;
+
+    std::mutex staging_mutex;
+    TunableParameters staging;
+    std::atomic<long> version;
+    long taken_version;
+
+    void watchLoop();
+    void reload();
+
+public:
+    explicit ConfigWatcher(const std::string &path);
+    ~ConfigWatcher();
+
+    // Called from the control thread. Copies the new parameters if there is an unseen
+    // version and nobody is writing them right now, never blocks.
+    bool poll(TunableParameters &parameters);
+};
+
+#endif
@@ -0,0 +1,74 @@
+#include "ControlPipeline.h"
+
+#include <iostream>
+#include <time.h>
+
+QueueSignal::QueueSignal()
+{
+    sem_init(&semaphore, 0, 0);
+}
+
+QueueSignal::~QueueSignal()
+{
+    sem_destroy(&semaphore);
+}
+
+void QueueSignal::notify()
+{
+    sem_post(&semaphore);
+}
+
+bool QueueSignal::wait(double timeout)
+{
+    //sem_timedwait only takes an absolute CLOCK_REALTIME deadline.
+    timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += (time_t)timeout;
+    deadline.tv_nsec += (long)((timeout - (time_t)timeout) * 1e9);
+    if(deadline.tv_nsec >= 1000000000L){
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    return sem_timedwait(&semaphore, &deadline) == 0;
+}
+
+void StageLatency::print(const std::string &name) const
+{
+    std::cout << "  " << name << ": mean " << (count ? sum / count : 0.0) * 1e6 << "us max " << max * 1e6 << "us" << std::endl;
+}
+
+void PipelineStats::print() const
+{
+    std::cout << "Pipeline latency:" << std::endl;
+    sense.print("sense");
+    sensor_queue.print("sensor queue");
+    solve.print("solve");
+    command_queue.print("command queue");
+    actuate.print("actuate");
+    end_to_end.print("end to end");
+    std::cout << "  Skipped " << stale_samples << " stale samples and " << stale_commands << " stale commands, "
+    << sensor_overflows << " sensor and " << command_overflows << " command queue overflows." << std::endl;
+}
+
+void pinCurrentThread(int cpu)
+{
+    if(cpu < 0) return;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        std::cout << "Could not pin a pipeline thread to core " << cpu << std::endl;
+}
+
+ScopedThreadPin::ScopedThreadPin(int cpu) : thread(pthread_self()), pinned(false)
+{
+    if(cpu < 0 || pthread_getaffinity_np(thread, sizeof(previous), &previous) != 0) return;
+    pinCurrentThread(cpu);
+    pinned = true;
+}
+
+ScopedThreadPin::~ScopedThreadPin()
+{
+    if(pinned) pthread_setaffinity_np(thread, sizeof(previous), &previous);
+}
@@ -0,0 +1,145 @@
+#ifndef DoublePENDULUM_CONTROLPIPELINE_H
+#define DoublePENDULUM_CONTROLPIPELINE_H
+
+#include <Eigen/Dense>
+
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Bounded single producer single consumer ring. The slots are allocated once, push and pop
+// only copy and never block: a full queue refuses the push, an empty one the pop.
+template<typename T>
+class SPSCQueue
+{
+private:
+    std::vector<T> ring;
+    // Written by the consumer and the producer only, on their own cache lines.
+    alignas(64) std::atomic<std::size_t> head;
+    alignas(64) std::atomic<std::size_t> tail;
+
+public:
+    explicit SPSCQueue(std::size_t capacity) : ring(capacity + 1), head(0), tail(0) {}
+
+    bool push(const T &item)
+    {
+        const std::size_t t = tail.load(std::memory_order_relaxed);
+        const std::size_t next = t + 1 == ring.size() ? 0 : t + 1;
+        if(next == head.load(std::memory_order_acquire)) return false;
+        ring[t] = item;
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item)
+    {
+        const std::size_t h = head.load(std::memory_order_relaxed);
+        if(h == tail.load(std::memory_order_acquire)) return false;
+        item = ring[h];
+        head.store(h + 1 == ring.size() ? 0 : h + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+// Fixed size, so going through the queues never allocates.
+struct SensorSample
+{
+    long tick;
+    double t;
+    Eigen::Matrix<double, 4, 1, Eigen::DontAlign> x;
+};
+
+struct ActuationCommand
+{
+    long tick;
+    double t_measurement;
+    double t_sent;
+    Eigen::Matrix<double, 2, 1, Eigen::DontAlign> torque;
+};
+
+// Sent back by the actuation stage once the torque is written, so the estimator knows when it
+// started acting.
+struct AppliedTorque
+{
+    long tick;
+    double t_applied;
+    Eigen::Matrix<double, 2, 1, Eigen::DontAlign> torque;
+};
+
+// Wakes the consumer of a queue instead of having it spin. The producer notifies after every
+// push, so a wake up may find the queue already drained and the consumer just checks again.
+class QueueSignal
+{
+private:
+    sem_t semaphore;
+
+public:
+    QueueSignal();
+    ~QueueSignal();
+
+    void notify();
+    // False on timeout or when a signal interrupted the wait.
+    bool wait(double timeout);
+};
+
+// Running mean and max of a latency, owned by one thread.
+struct StageLatency
+{
+    double sum;
+    double max;
+    long count;
+
+    StageLatency() : sum(0), max(0), count(0) {}
+
+    void add(double seconds)
+    {
+        sum += seconds;
+        max = seconds > max ? seconds : max;
+        count++;
+    }
+
+    void print(const std::string &name) const;
+};
+
+// Latency of each stage of the pipelined control loop, and the samples and commands that
+// were skipped because a newer one was already waiting or the queue was full.
+struct PipelineStats
+{
+    StageLatency sense;        // encoder reads
+    StageLatency sensor_queue; // from the measurement to the start of its solve
+    StageLatency solve;        // estimators, solve and bookkeeping before the command is sent
+    StageLatency command_queue;
+    StageLatency actuate;      // torque writes
+    StageLatency end_to_end;   // from the measurement to its torque written
+
+    long stale_samples;
+    long stale_commands;
+    long sensor_overflows;
+    long command_overflows;
+
+    PipelineStats() : stale_samples(0), stale_commands(0), sensor_overflows(0), command_overflows(0) {}
+
+    void print() const;
+};
+
+// Pins the calling thread to a core, a negative one leaves it free.
+void pinCurrentThread(int cpu);
+
+// Pins the calling thread while in scope and gives it back its previous affinity after.
+class ScopedThreadPin
+{
+private:
+    pthread_t thread;
+    cpu_set_t previous;
+    bool pinned;
+
+public:
+    explicit ScopedThreadPin(int cpu);
+    ~ScopedThreadPin();
+};
+
+#endif
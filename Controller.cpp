@@ -1,20 +1,38 @@
 #include "Controller.h"
 
-Controller::Controller(std::string model_path,std::string config_path)
+#include <mutex>
+#include <time.h>
+
+Controller::Controller(std::string model_path,std::string config_path) : tick_allocations(0), forbid_eigen_malloc(false),
+    graph_logger(nullptr), r(nullptr), owns_robot(false), odrive(nullptr)
 {
     config = YAML::LoadFile(config_path);
 
     //Actuation of pendulum.
     config_actuated_link = static_cast<actuated_link>(config["actuated_link"].as<int>());
 
+    this->config_path = config_path;
+    construction_time = std::chrono::steady_clock::now();
+    if(config["startup_cache"])
+        startup_cache = boost::make_shared<StartupCache>(config["startup_cache"].as<std::string>(), model_path, config_path);
+
     this->loadModel(model_path);
     this->loadConfig(config_path);
+    this->loadJointLimits();
     
     trajectory_xs.resize(T_ROUTE, state->zero());
     trajectory_us.resize(T_ROUTE, state->zero());
 
     mpc_warmStart_xs.resize(T_MPC, state->zero());
-    mpc_warmStart_us.resize(T_MPC, Eigen::VectorXd::Zero(actuation_model->get_nu()));
+    mpc_warmStart_us.resize(T_MPC - 1, Eigen::VectorXd::Zero(actuation_model->get_nu()));
+
+    mpc_torque = Eigen::VectorXd::Zero(actuation_model->get_nu());
+
+    if(use_lqr_balance) createLQR();
+
+    if(config_controller_mode == POLICY_MODE) loadPolicy(policy_path);
+
+    if(watch_config) config_watcher = boost::make_shared<ConfigWatcher>(config_path);
 }
 
 Controller::~Controller()
@@ -25,19 +43,24 @@ Controller::~Controller()
     if(graph_logger) delete graph_logger;
     #endif
 
-    if(r) delete r;
+    if(r && owns_robot) delete r;
 }
 
 void Controller::loadModel(std::string path)
 {
-    // Create the arm model based on the URDF.
-    pinocchio::urdf::buildModel(path, model);
+    // Create the arm model based on the URDF, unless the startup cache has it already built.
+    if(!startup_cache || !startup_cache->loadModel(model))
+    {
+        pinocchio::urdf::buildModel(path, model);
+        if(startup_cache) startup_cache->setModel(model);
+    }
     
     // Create the state vector. Simple pendulum has q and dot_q.
     state = boost::make_shared<crocoddyl::StateMultibody>(boost::make_shared<pinocchio::Model>(model));
-    actuation_model = boost::make_shared<ActuationModelDoublePendulum>(state, 2, model.nv, config_actuated_link);
+    actuation_model = boost::make_shared<ActuationModelPendulumTpl<double, NJoints>>(state, NJoints, model.nv, config_actuated_link);
 
     initial_state = Eigen::VectorXd(state->get_nx());
+    measured_state = Eigen::VectorXd(state->get_nx());
 
     std::cout << "Model has: "   << std::endl << "nq: " << state->get_nq() << std::endl
     << "nx: " << state->get_nx() << std::endl
@@ -55,102 +78,524 @@ void Controller::loadConfig(std::string configPath)
     
     // Costs
     activation_model_weights = Eigen::VectorXd(6);
-    activation_model_weights <<  config["Sin_theta_Weight"].as<double>(), config["Sin_alpha_Weight"].as<double>(),
-        config["Cos_theta_Weight"].as<double>(), config["Cos_alpha_Weight"].as<double>(),
-        config["Vel_theta_Weight"].as<double>(), config["Vel_alpha_Weight"].as<double>();
-
-    x_reg_weight = config["xReg"].as<double>();
-    u_reg_weight = config["uReg"].as<double>();
-    
-    trajectory_node_weight = config["trajectory_node_weight"].as<double>();
-    trajectory_terminal_weight = config["trajectory_terminal_weight"].as<double>();
-    
-    running_model_goal_weight = config["running_model_goal_weight"].as<double>();
-    terminal_model_goal_weight = config["terminal_model_goal_weight"].as<double>();
-
     torque_limit_ub = Eigen::VectorXd(actuation_model->get_nu());
     torque_limit_lb = Eigen::VectorXd(actuation_model->get_nu());
 
-    torque_limit_ub.fill(config["tau_ub"].as<double>());
-	torque_limit_lb.fill(config["tau_lb"].as<double>());
+    //A valid cache was written with this same config file.
+    setTunableParameters(startup_cache && startup_cache->isValid() ? startup_cache->get_parameters() : TunableParameters::fromYAML(config));
+    startup_cache_state_tolerance = config["startup_cache_state_tolerance"].as<double>(0.05);
+
+    trajectory_continuation_stages = config["trajectory_continuation_stages"].as<int>(0);
+    trajectory_continuation_torque_relaxation = config["trajectory_continuation_torque_relaxation"].as<double>(3);
+    trajectory_continuation_weight_ratio = config["trajectory_continuation_weight_ratio"].as<double>(0.01);
+    trajectory_continuation_iterations = config["trajectory_continuation_iterations"].as<int>(20);
+    trajectory_continuation_compare = config["trajectory_continuation_compare"].as<bool>(false);
 
     T_ROUTE = config["T_ROUTE"].as<double>();
     T_MPC = config["T_MPC"].as<double>();
 
-    trajectory_solver_iterations = config["initial_solver_iterations"].as<int>();
-    mpc_solver_iterations = config["solver_iterations"].as<int>();
-
     goto_base_position = config["goto_base_position"].as<bool>();
     zero_the_initial_position = config["zero_the_initial_position"].as<bool>();
 
     use_callback_verbose = config["use_callback_verbose"].as<bool>();
 
     control_loop_iterations = config["control_loop_iterations"].as<int>();
+
+    max_joint_velocity = config["max_joint_velocity"].as<double>(25);
+    joint_limit_abort_factor = config["joint_limit_abort_factor"].as<double>(1.2);
+
+    watch_config = config["watch_config"].as<bool>(false);
+    record_session_path = config["record_session"].as<std::string>("");
+
+    telemetry_socket_path = config["telemetry_socket"].as<std::string>("");
+    supervisor_shm_name = config["supervisor_shm"].as<std::string>("");
+
+    if(config["adaptive_horizons"])
+        adaptive_horizons = config["adaptive_horizons"].as<std::vector<int>>();
+    adaptive_min_iterations = config["adaptive_min_iterations"].as<int>(1);
+    adaptive_max_iterations = config["adaptive_max_iterations"].as<int>(mpc_solver_iterations);
+    adaptive_budget = config["adaptive_budget"].as<double>(0.8);
+    adaptive_high_watermark = config["adaptive_high_watermark"].as<double>(0.9);
+    adaptive_low_watermark = config["adaptive_low_watermark"].as<double>(0.5);
+    adaptive_patience = config["adaptive_patience"].as<int>(50);
+    adaptive_cost_tolerance = config["adaptive_cost_tolerance"].as<double>(1e-4);
+
+    use_condensed_qp = config["mpc_backend"].as<std::string>("fddp") == "condensed";
+    condensed_qp_iterations = config["condensed_qp_iterations"].as<int>(20);
+    early_stop_threshold = config["early_stop_threshold"].as<double>(0);
+    early_stop_gap_tolerance = config["early_stop_gap_tolerance"].as<double>(1e-3);
+    gain_reuse_state_tolerance = config["gain_reuse_state_tolerance"].as<double>(0.01);
+    max_gain_reuse = config["max_gain_reuse"].as<int>(0);
+    pipelined_control = config["pipelined_control"].as<bool>(false);
+    pipeline_queue_capacity = config["pipeline_queue_capacity"].as<int>(4);
+    if(config["pipeline_cpus"])
+        pipeline_cpus = config["pipeline_cpus"].as<std::vector<int>>();
+    telemetry_capacity = config["telemetry_capacity"].as<int>(4096);
+    telemetry_batch_size = config["telemetry_batch_size"].as<int>(64);
+    telemetry_batch_period = config["telemetry_batch_period"].as<double>(0.02);
+
+    config_controller_mode = static_cast<controller_mode>(config["controller_mode"].as<int>(FDDP_MODE));
+    swing_up_tolerance = config["swing_up_tolerance"].as<double>(0.2);
+
+    mppi_samples = config["mppi_samples"].as<int>(256);
+    mppi_noise_sigma = config["mppi_noise_sigma"].as<double>(0.05);
+    mppi_temperature = config["mppi_temperature"].as<double>(1.0);
+    mppi_threads = config["mppi_threads"].as<int>(std::thread::hardware_concurrency());
+    mppi_single_precision = config["mppi_precision"].as<std::string>("double") == "float";
+
+    scenario_count = config["scenario_count"].as<int>(4);
+    scenario_spread.mass = config["scenario_mass_spread"].as<double>(0.1);
+    scenario_spread.torque_constant = config["scenario_torque_constant_spread"].as<double>(0.1);
+    scenario_spread.viscous_friction = config["scenario_viscous_friction"].as<double>(0.01);
+    scenario_spread.coulomb_friction = config["scenario_coulomb_friction"].as<double>(0.02);
+    scenario_consensus_weight = config["scenario_consensus_weight"].as<double>(10);
+    scenario_consensus_rounds = config["scenario_consensus_rounds"].as<int>(3);
+    scenario_threads = config["scenario_threads"].as<int>(std::thread::hardware_concurrency());
+
+    policy_path = config["policy_path"].as<std::string>("policy.bin");
+    policy_confidence_radius = config["policy_confidence_radius"].as<double>(0.5);
+    if(config["policy_state_scale"])
+    {
+        std::vector<double> scale = config["policy_state_scale"].as<std::vector<double>>();
+        policy_state_scale = Eigen::Map<Eigen::VectorXd>(scale.data(), scale.size());
+    }else{
+        policy_state_scale = Eigen::VectorXd::Ones(state->get_nx());
+    }
+    policy_state_noise = config["policy_state_noise"].as<double>(0.3);
+    policy_solver_iterations = config["policy_solver_iterations"].as<int>(100);
+
+    use_online_sysid = config["use_online_sysid"].as<bool>(false);
+    sysid_update_period = config["sysid_update_period"].as<int>(500);
+    sysid_mass_prior_std = config["sysid_mass_prior_std"].as<double>(0.02);
+    sysid_parameter_prior_std = config["sysid_parameter_prior_std"].as<double>(0.5);
+    sysid_forgetting_factor = config["sysid_forgetting_factor"].as<double>(1.0);
+    sysid_acceleration_filter = config["sysid_acceleration_filter"].as<double>(0.2);
+    friction_smoothing = config["friction_smoothing"].as<double>(0.01);
+    scenario_spread.friction_smoothing = friction_smoothing;
+
+    use_state_estimator = config["use_state_estimator"].as<bool>(false);
+    if(use_state_estimator)
+    {
+        std::vector<double> process_noise = config["estimator_process_noise"].as<std::vector<double>>();
+        std::vector<double> measurement_noise = config["estimator_measurement_noise"].as<std::vector<double>>();
+        estimator_process_noise = Eigen::Map<Eigen::VectorXd>(process_noise.data(), process_noise.size());
+        estimator_measurement_noise = Eigen::Map<Eigen::VectorXd>(measurement_noise.data(), measurement_noise.size());
+    }
+    estimator_max_step = config["estimator_max_step"].as<double>(dt / 4);
+    actuation_latency = config["actuation_latency"].as<double>(0.001);
+
+    use_lqr_balance = config["use_lqr_balance"].as<bool>(false);
+    if(use_lqr_balance)
+    {
+        std::vector<double> Q = config["lqr_Q"].as<std::vector<double>>();
+        std::vector<double> R = config["lqr_R"].as<std::vector<double>>();
+        lqr_Q = Eigen::Map<Eigen::VectorXd>(Q.data(), Q.size());
+        lqr_R = Eigen::Map<Eigen::VectorXd>(R.data(), R.size());
+        lqr_roa_enter = config["lqr_roa_enter"].as<double>();
+        lqr_roa_exit = config["lqr_roa_exit"].as<double>();
+    }
+}
+
+void Controller::setTunableParameters(const TunableParameters& parameters)
+{
+    activation_model_weights = parameters.goal_weights;
+
+    x_reg_weight = parameters.x_reg_weight;
+    u_reg_weight = parameters.u_reg_weight;
+
+    trajectory_node_weight = parameters.trajectory_node_weight;
+    trajectory_terminal_weight = parameters.trajectory_terminal_weight;
+
+    running_model_goal_weight = parameters.running_model_goal_weight;
+    terminal_model_goal_weight = parameters.terminal_model_goal_weight;
+
+    joint_limit_weight = parameters.joint_limit_weight;
+
+    torque_limit_ub.fill(parameters.tau_ub);
+    torque_limit_lb.fill(parameters.tau_lb);
+
+    trajectory_solver_iterations = parameters.trajectory_solver_iterations;
+    mpc_solver_iterations = parameters.mpc_solver_iterations;
+}
+
+TunableParameters Controller::getTunableParameters() const
+{
+    TunableParameters parameters;
+    parameters.goal_weights = activation_model_weights;
+    parameters.x_reg_weight = x_reg_weight;
+    parameters.u_reg_weight = u_reg_weight;
+    parameters.trajectory_node_weight = trajectory_node_weight;
+    parameters.trajectory_terminal_weight = trajectory_terminal_weight;
+    parameters.running_model_goal_weight = running_model_goal_weight;
+    parameters.terminal_model_goal_weight = terminal_model_goal_weight;
+    parameters.joint_limit_weight = joint_limit_weight;
+    parameters.tau_ub = torque_limit_ub[0];
+    parameters.tau_lb = torque_limit_lb[0];
+    parameters.trajectory_solver_iterations = trajectory_solver_iterations;
+    parameters.mpc_solver_iterations = mpc_solver_iterations;
+    return parameters;
+}
+
+template<typename Scalar>
+static void setCostWeight(const boost::shared_ptr<crocoddyl::CostModelSumTpl<Scalar>>& costs, const std::string& name, double weight)
+{
+    auto item = costs->get_costs().find(name);
+    if(item != costs->get_costs().end()) item->second->weight = weight;
+}
+
+//Applies the parameters in place on the current problem. Running nodes share one cost sum,
+//so this is a handful of assignments and never allocates. Costs that were disabled with a 0
+//weight when the problem was created are not in the sums and need createDOCP.
+void Controller::applyTunableParameters(const TunableParameters& parameters)
+{
+    setTunableParameters(parameters);
+
+    boost::static_pointer_cast<crocoddyl::ActivationModelWeightedQuad>(x_goal_cost->get_activation())->set_weights(activation_model_weights);
+    setGoalActivationData(problem, activation_model_weights);
+    for(auto const& horizon_solver: horizon_solvers)
+        if(horizon_solver->get_problem() != problem) setGoalActivationData(horizon_solver->get_problem(), activation_model_weights);
+    if(condensed_solver) condensed_solver->setGoalWeights(activation_model_weights);
+
+    setCostWeight(running_cost_model_sum, "x_goal", docp_is_trajectory ? trajectory_node_weight : running_model_goal_weight);
+    setCostWeight(terminal_cost_model_sum, "x_goal", docp_is_trajectory ? trajectory_terminal_weight : terminal_model_goal_weight);
+    setCostWeight(terminal_cost_model_sum, "x_reg", x_reg_weight);
+    setCostWeight(terminal_cost_model_sum, "u_reg", u_reg_weight);
+    setCostWeight(running_cost_model_sum, "joint_limits", joint_limit_weight);
+    setCostWeight(terminal_cost_model_sum, "joint_limits", joint_limit_weight);
+
+    //The integrated models keep their own copy of the limits, and that is the one the box solvers read.
+    for(std::size_t i = 0; i < differential_models_running.size(); i++){
+        differential_models_running[i]->set_u_ub(torque_limit_ub);
+        differential_models_running[i]->set_u_lb(torque_limit_lb);
+        integrated_models_running[i]->set_u_ub(torque_limit_ub);
+        integrated_models_running[i]->set_u_lb(torque_limit_lb);
+    }
+    differential_terminal_model->set_u_ub(torque_limit_ub);
+    differential_terminal_model->set_u_lb(torque_limit_lb);
+    integrated_terminal_model->set_u_ub(torque_limit_ub);
+    integrated_terminal_model->set_u_lb(torque_limit_lb);
+
+    if(mppi_solver) mppi_solver->set_bounds(torque_limit_lb, torque_limit_ub);
+    if(float_mppi_solver) applyFloatParameters();
+    if(scenario_mpc){
+        scenario_mpc->syncWeights();
+        scenario_mpc->set_bounds(torque_limit_lb, torque_limit_ub);
+    }
+    if(lqr) lqr->set_bounds(torque_limit_lb, torque_limit_ub);
+
+    invalidateGains();
+}
+
+void Controller::loadJointLimits()
+{
+    pendulumStateLimits(model, max_joint_velocity, state_limit_lb, state_limit_ub);
+
+    std::cout << "State limits:" << std::endl << "lb: " << state_limit_lb.transpose() << std::endl
+    << "ub: " << state_limit_ub.transpose() << std::endl;
+}
+
+//The range is widened by (factor - 1) times its width on each side. Scaling the bounds themselves
+//would narrow any range that does not straddle zero.
+bool Controller::isOutOfLimits(const Eigen::VectorXd& x)
+{
+    for(int i = 0; i < x.size(); i++){
+        const double margin = (joint_limit_abort_factor - 1) * (state_limit_ub[i] - state_limit_lb[i]);
+        if(x[i] > state_limit_ub[i] + margin || x[i] < state_limit_lb[i] - margin)
+            return true;
+    }
+    return false;
+}
+
+PendulumCostWeights Controller::costWeights(bool trajectory) const
+{
+    PendulumCostWeights weights;
+    weights.goal = activation_model_weights;
+    weights.running_goal = trajectory ? trajectory_node_weight : running_model_goal_weight;
+    weights.terminal_goal = trajectory ? trajectory_terminal_weight : terminal_model_goal_weight;
+    weights.x_reg = x_reg_weight;
+    weights.u_reg = u_reg_weight;
+    weights.joint_limit = joint_limit_weight;
+    return weights;
 }
 
 void Controller::createDOCP(bool trajectory)
 {
+    docp_is_trajectory = trajectory;
     differential_models_running.clear();
     integrated_models_running.clear();
+    early_stop_solvers.clear();
     
-    running_cost_model_sum  = boost::make_shared<crocoddyl::CostModelSum>(state, actuation_model->get_nu());
-    terminal_cost_model_sum = boost::make_shared<crocoddyl::CostModelSum>(state, actuation_model->get_nu());
-    
-    x_reg_cost = boost::make_shared<crocoddyl::CostModelState>(state, boost::make_shared<crocoddyl::ActivationModelQuad>(state->get_ndx()), state->zero(),
-            actuation_model->get_nu());
-    
-    u_reg_cost = boost::make_shared<crocoddyl::CostModelControl>(state, boost::make_shared<crocoddyl::ActivationModelQuad>(2),
-			actuation_model->get_nu());
-
-    x_goal_cost = boost::make_shared<CostModelDoublePendulum>(state,
-	 		boost::make_shared<crocoddyl::ActivationModelWeightedQuad>(activation_model_weights),actuation_model->get_nu());
+    //Goal, regularizations and the barrier on the joint limits, so the solver plans inside them.
+    PendulumCostsTpl<double, NJoints> costs(state, actuation_model->get_nu(), costWeights(trajectory), state_limit_lb, state_limit_ub);
+    running_cost_model_sum = costs.running;
+    terminal_cost_model_sum = costs.terminal;
+    x_reg_cost = costs.x_reg;
+    u_reg_cost = costs.u_reg;
+    joint_limit_cost = costs.joint_limits;
+    x_goal_cost = costs.goal;
 
     //Defineix la theta de referencia igual a tots els nodes. No hi ha cap WP.
-    x_goal_cost->setReference(0.0, 0.0, 0.0 , 0.0);
+    goal_reference = state->zero();
+
+    int nodes = trajectory ? T_ROUTE : T_MPC;
 
-    // Add the var regularization
-    if(u_reg_weight != 0) terminal_cost_model_sum->addCost("u_reg", u_reg_cost, u_reg_weight);
-    if(x_reg_weight != 0) terminal_cost_model_sum->addCost("x_reg", x_reg_cost, x_reg_weight);
+    PendulumModelsTpl<double> models(state, actuation_model, running_cost_model_sum, terminal_cost_model_sum, nodes, dt,
+                                     torque_limit_lb, torque_limit_ub);
+    differential_models_running = models.differential_running;
+    integrated_models_running = models.running;
+    differential_terminal_model = models.differential_terminal;
+    integrated_terminal_model = models.terminal;
+    std::cout << "There are " << differential_models_running.size() << " diferential models running." << std::endl; 
+
+    problem = models.createProblem(initial_state);
+
+    if(trajectory) solver = boost::make_shared<crocoddyl::SolverBoxFDDP>(problem);
+    else solver = createMPCSolver(problem);
+
+    condensed_solver.reset();
+    if(!trajectory && config_controller_mode != MPPI_MODE && use_condensed_qp)
+        condensed_solver = boost::make_shared<SolverCondensedQP>(problem, condensed_qp_iterations);
+
+    scenario_mpc.reset();
+    if(!trajectory && config_controller_mode == SCENARIO_MODE)
+        scenario_mpc = boost::make_shared<ScenarioMPC>(model, config_actuated_link, running_cost_model_sum, terminal_cost_model_sum, T_MPC, dt,
+                                                       scenario_count, scenario_spread, scenario_consensus_weight, scenario_consensus_rounds,
+                                                       scenario_threads, torque_limit_lb, torque_limit_ub);
+
+    float_mppi_solver.reset();
+    if(!trajectory && config_controller_mode == MPPI_MODE)
+    {
+        if(mppi_single_precision) createFloatMPPI();
+        else mppi_solver = boost::make_shared<SolverMPPI>(problem, mppi_samples, mppi_noise_sigma, mppi_temperature,
+                                                          mppi_threads, torque_limit_lb, torque_limit_ub);
+    }
+
+    if(!trajectory && !adaptive_horizons.empty())
+        createScheduler();
+
+    if(use_callback_verbose && trajectory)
+        addCallbackVerbose();
+}
+
+//Mirrors the MPC problem of createDOCP in single precision: the same costs with the same
+//weights and references, on a float copy of the pinocchio model. Only MPPI runs on it,
+//the crocoddyl solvers are double only.
+void Controller::createFloatMPPI()
+{
+    float_state = boost::make_shared<crocoddyl::StateMultibodyTpl<float>>(boost::make_shared<pinocchio::ModelTpl<float>>(model.cast<float>()));
+    float_actuation_model = boost::make_shared<ActuationModelPendulumTpl<float, NJoints>>(float_state, NJoints, model.nv, config_actuated_link);
+    const std::size_t nu = float_actuation_model->get_nu();
+
+    PendulumCostsTpl<float, NJoints> costs(float_state, nu, costWeights(false), state_limit_lb, state_limit_ub);
+    float_running_cost_model_sum = costs.running;
+    float_terminal_cost_model_sum = costs.terminal;
+    float_x_goal_cost = costs.goal;
+    float_activation_weights = activation_model_weights.cast<float>();
+    float_goal = state->zero().cast<float>();
+
+    float_torque_limit_lb = torque_limit_lb.cast<float>();
+    float_torque_limit_ub = torque_limit_ub.cast<float>();
+
+    PendulumModelsTpl<float> models(float_state, float_actuation_model, float_running_cost_model_sum, float_terminal_cost_model_sum,
+                                    T_MPC, float(dt), float_torque_limit_lb, float_torque_limit_ub);
+    float_differential_models = models.differential_running;
+    float_differential_models.push_back(models.differential_terminal);
+
+    float_x0 = initial_state.cast<float>();
+    float_problem = models.createProblem(float_x0);
+    float_mppi_solver = boost::make_shared<SolverMPPITpl<float>>(float_problem, mppi_samples, float(mppi_noise_sigma), float(mppi_temperature),
+                                                                 mppi_threads, float_torque_limit_lb, float_torque_limit_ub);
+
+    float_warm_start_us.assign(T_MPC - 1, Eigen::VectorXf::Zero(nu));
+    float_solution_xs.assign(T_MPC, state->zero());
+    float_solution_us.assign(T_MPC - 1, Eigen::VectorXd::Zero(nu));
+}
+
+//The float side of applyTunableParameters. Assigns into the buffers createFloatMPPI sized.
+void Controller::applyFloatParameters()
+{
+    float_activation_weights = activation_model_weights.cast<float>();
+    boost::static_pointer_cast<crocoddyl::ActivationModelWeightedQuadTpl<float>>(float_x_goal_cost->get_activation())->set_weights(float_activation_weights);
+    setGoalActivationData(float_problem, float_activation_weights);
+
+    setCostWeight(float_running_cost_model_sum, "x_goal", running_model_goal_weight);
+    setCostWeight(float_terminal_cost_model_sum, "x_goal", terminal_model_goal_weight);
+    setCostWeight(float_terminal_cost_model_sum, "x_reg", x_reg_weight);
+    setCostWeight(float_terminal_cost_model_sum, "u_reg", u_reg_weight);
+    setCostWeight(float_running_cost_model_sum, "joint_limits", joint_limit_weight);
+    setCostWeight(float_terminal_cost_model_sum, "joint_limits", joint_limit_weight);
+
+    float_torque_limit_lb = torque_limit_lb.cast<float>();
+    float_torque_limit_ub = torque_limit_ub.cast<float>();
+    for(auto const& diff_model: float_differential_models){
+        diff_model->set_u_lb(float_torque_limit_lb);
+        diff_model->set_u_ub(float_torque_limit_ub);
+    }
+    float_mppi_solver->set_bounds(float_torque_limit_lb, float_torque_limit_ub);
+}
 
-    if(trajectory){
-        running_cost_model_sum-> addCost("x_goal", x_goal_cost, trajectory_node_weight);
-        terminal_cost_model_sum->addCost("x_goal", x_goal_cost, trajectory_terminal_weight);
+//Builds the shorter problems on top of the running models of the MPC problem, so they
+//only add their own data. MPPI and the condensed QP keep the full horizon and only adapt the iterations.
+void Controller::createScheduler()
+{
+    std::vector<int> horizons;
+    if(config_controller_mode == MPPI_MODE || config_controller_mode == SCENARIO_MODE || condensed_solver){
+        horizons.push_back(T_MPC);
     }else{
-        running_cost_model_sum-> addCost("x_goal", x_goal_cost, running_model_goal_weight);
-        terminal_cost_model_sum->addCost("x_goal", x_goal_cost, terminal_model_goal_weight);    
+        for(int horizon: adaptive_horizons)
+            if(horizon >= 2 && horizon <= T_MPC) horizons.push_back(horizon);
+        if(std::find(horizons.begin(), horizons.end(), (int)T_MPC) == horizons.end()) horizons.push_back(T_MPC);
     }
 
-    int nodes = trajectory ? T_ROUTE : T_MPC;
+    scheduler = boost::make_shared<SolveScheduler>(horizons, adaptive_min_iterations, adaptive_max_iterations,
+                                                   adaptive_budget * dt, adaptive_high_watermark, adaptive_low_watermark, adaptive_patience);
 
-    for (int i = 0; i < nodes - 1; ++i)
+    horizon_solvers.clear();
+    active_horizon_level = -1;
+    horizon_warm_start_xs.clear();
+    horizon_warm_start_us.clear();
+
+    for(int level = 0; level < scheduler->get_levels(); level++)
     {
-        boost::shared_ptr<crocoddyl::DifferentialActionModelFreeFwdDynamics> diff_model = 
-        boost::make_shared<crocoddyl::DifferentialActionModelFreeFwdDynamics>(state, actuation_model, running_cost_model_sum);
+        const int horizon = scheduler->get_horizon(level);
+
+        if(horizon == T_MPC){
+            horizon_solvers.push_back(solver);
+        }else{
+            std::vector<boost::shared_ptr<crocoddyl::ActionModelAbstract>> models(integrated_models_running.begin(),
+                                                                                 integrated_models_running.begin() + horizon - 1);
+            horizon_solvers.push_back(createMPCSolver(
+                boost::make_shared<crocoddyl::ShootingProblem>(initial_state, models, integrated_terminal_model)));
+        }
+
+        horizon_warm_start_xs.push_back(std::vector<Eigen::VectorXd>(horizon, state->zero()));
+        horizon_warm_start_us.push_back(std::vector<Eigen::VectorXd>(horizon - 1, Eigen::VectorXd::Zero(actuation_model->get_nu())));
+    }
 
-        diff_model->set_u_ub(torque_limit_ub);
-        diff_model->set_u_lb(torque_limit_lb);
+    std::cout << "Adaptive scheduler with " << scheduler->get_levels() << " horizons from " << scheduler->get_horizon(0)
+    << " to " << scheduler->get_horizon(scheduler->get_levels() - 1) << " nodes." << std::endl;
+}
 
-        boost::shared_ptr<crocoddyl::IntegratedActionModelEuler> int_model =
-        boost::make_shared<crocoddyl::IntegratedActionModelEuler>(diff_model, dt);
+//Plain Box-FDDP unless the early stop or the gain reuse are enabled in the config.
+boost::shared_ptr<crocoddyl::SolverBoxFDDP> Controller::createMPCSolver(const boost::shared_ptr<crocoddyl::ShootingProblem>& mpc_problem)
+{
+    if(early_stop_threshold <= 0 && max_gain_reuse <= 0)
+        return boost::make_shared<crocoddyl::SolverBoxFDDP>(mpc_problem);
+
+    boost::shared_ptr<SolverEarlyStop> early_stop_solver = boost::make_shared<SolverEarlyStop>(mpc_problem);
+    early_stop_solver->setEarlyStop(early_stop_threshold, early_stop_gap_tolerance);
+    early_stop_solver->setGainReuse(gain_reuse_state_tolerance, max_gain_reuse);
+    early_stop_solvers.push_back(early_stop_solver);
+    return early_stop_solver;
+}
+
+void Controller::createLQR()
+{
+    //Upright equilibrium, the same reference as the goal cost.
+    lqr = boost::make_shared<LQRStabilizer>(state, actuation_model, dt, state->zero(), lqr_Q, lqr_R,
+                                            lqr_roa_enter, lqr_roa_exit, torque_limit_lb, torque_limit_ub);
+}
 
-        differential_models_running.push_back(diff_model);
-        integrated_models_running.push_back(int_model);
+void Controller::loadPolicy(std::string path)
+{
+    policy = boost::make_shared<ExplicitPolicy>(state->get_nx(), actuation_model->get_nu(), state->get_nq());
+    policy->setMetric(policy_state_scale, policy_confidence_radius);
+
+    if(!policy->load(path))
+        std::cout << "Could not load the policy from " << path << ". Every tick will use the MPC." << std::endl;
+}
+
+//Offline: solves the MPC problem around the generated trajectory and stores the first control and gain.
+//Needs createTrajectory() and then createDOCP(false).
+void Controller::buildPolicy(int samples, std::string path)
+{
+    ExplicitPolicy new_policy(state->get_nx(), actuation_model->get_nu(), state->get_nq());
+
+    std::mt19937 generator(0);
+    std::normal_distribution<double> noise(0, policy_state_noise);
+    std::uniform_int_distribution<int> trajectory_node(0, T_ROUTE - T_MPC);
+
+    Eigen::VectorXd x0(state->get_nx());
+    int rejected = 0;
+
+    for(int i = 0; i < samples; i++)
+    {
+        int node = trajectory_node(generator);
+        for(int j = 0; j < x0.size(); j++)
+            x0[j] = trajectory_xs[node][j] + noise(generator);
+
+        std::copy(trajectory_xs.begin() + node, trajectory_xs.begin() + node + mpc_warmStart_xs.size(), mpc_warmStart_xs.begin());
+        std::copy(trajectory_us.begin() + node, trajectory_us.begin() + node + mpc_warmStart_us.size(), mpc_warmStart_us.begin());
+        mpc_warmStart_xs[0] = x0;
+
+        problem->set_x0(x0);
+        solver->solve(mpc_warmStart_xs, mpc_warmStart_us, policy_solver_iterations, false, 1e-9);
+
+        if(!solver->get_is_feasible() || !std::isfinite(solver->get_cost())){
+            rejected++;
+            continue;
+        }
+        new_policy.addSample(x0, solver->get_us()[0], solver->get_K()[0]);
+
+        if((i + 1) % std::max(samples / 10, 1) == 0)
+            std::cout << "Policy samples: " << i + 1 << "/" << samples << std::endl;
     }
-    std::cout << "There are " << differential_models_running.size() << " diferential models running." << std::endl; 
 
-    differential_terminal_model = boost::make_shared<crocoddyl::DifferentialActionModelFreeFwdDynamics>(state, actuation_model, terminal_cost_model_sum);
-    
-    differential_terminal_model->set_u_ub(torque_limit_ub);
-    differential_terminal_model->set_u_lb(torque_limit_lb);
-    
-    integrated_terminal_model = boost::make_shared<crocoddyl::IntegratedActionModelEuler>(differential_terminal_model, dt);
+    std::cout << "Rejected " << rejected << " samples that did not converge." << std::endl;
+    new_policy.save(path);
+}
 
-    problem = boost::make_shared<crocoddyl::ShootingProblem>(initial_state, integrated_models_running, integrated_terminal_model);
+//Needs the ODrive connected to read the nominal torque constants.
+void Controller::createParameterEstimator()
+{
+    nominal_torque_constants = Eigen::VectorXd(state->get_nv());
+    nominal_torque_constants << 1.0 / odrive->m0->castTorqueToCurrent(1.0), 1.0 / odrive->m1->castTorqueToCurrent(1.0);
+    motor_currents = Eigen::VectorXd::Zero(state->get_nv());
 
-    solver = boost::make_shared<crocoddyl::SolverBoxFDDP>(problem);
+    parameter_estimator = boost::make_shared<ParameterEstimator>(model, nominal_torque_constants, friction_smoothing,
+        sysid_mass_prior_std, sysid_parameter_prior_std, sysid_forgetting_factor, sysid_acceleration_filter);
+}
 
-    if(use_callback_verbose && trajectory)
-        addCallbackVerbose();
+void Controller::updateParameterEstimate(double t, const Eigen::VectorXd& x, const Eigen::VectorXd& currents)
+{
+    parameter_estimator->addSample(t, x.head(state->get_nq()), x.tail(state->get_nv()), currents);
+
+    if(parameter_estimator->get_sample_count() % sysid_update_period == 0)
+        applyIdentifiedParameters();
+}
+
+//Updates in place the model every action model points to, so there is no need to call createDOCP.
+void Controller::applyIdentifiedParameters()
+{
+    if(!parameter_estimator->applyToModel(*state->get_pinocchio())) return;
+    parameter_estimator->applyToModel(model);
+
+    actuation_model->setFriction(parameter_estimator->get_viscous_friction(), parameter_estimator->get_coulomb_friction(), friction_smoothing);
+    actuation_model->setTorqueScale(parameter_estimator->get_torque_constants().cwiseQuotient(nominal_torque_constants));
+
+    if(float_actuation_model){
+        //Only what the identification changed, in place. Casting the whole model allocates a new one.
+        pinocchio::ModelTpl<float> &float_model = *float_state->get_pinocchio();
+        for(std::size_t j = 1; j < model.inertias.size(); j++)
+            float_model.inertias[j] = model.inertias[j].cast<float>();
+        float_model.damping = model.damping.cast<float>();
+        float_model.friction = model.friction.cast<float>();
+        float_actuation_model->setFriction(parameter_estimator->get_viscous_friction().cast<float>(),
+                                           parameter_estimator->get_coulomb_friction().cast<float>(), float(friction_smoothing));
+        float_actuation_model->setTorqueScale(parameter_estimator->get_torque_constants().cwiseQuotient(nominal_torque_constants).cast<float>());
+    }
+}
+
+void Controller::printIdentifiedParameters()
+{
+    if(parameter_estimator) parameter_estimator->print();
+}
+
+void Controller::createStateEstimator()
+{
+    state_estimator = boost::make_shared<StateEstimator>(state, actuation_model, estimator_process_noise,
+                                                         estimator_measurement_noise, estimator_max_step);
+    expected_solve_time = 0;
 }
 
 void Controller::addCallbackVerbose()
@@ -163,7 +608,15 @@ void Controller::addCallbackVerbose()
 //Very Specific code for the simple pendulum.
 void Controller::connectODrive()
 {
-    r = new Robot(dt);
+    connectODrive(new Robot(dt), 0);
+    owns_robot = true;
+}
+
+//Uses the ODrive odrive_index of a Robot shared with other controllers.
+void Controller::connectODrive(Robot *robot, int odrive_index)
+{
+    r = robot;
+    owns_robot = false;
 
     auto *m0 = new Motor(M0);
     auto *m1 = new Motor(M1);
@@ -173,8 +626,8 @@ void Controller::connectODrive()
     m1->setOtherMotor(m0);
     
     //Check if there is any odrive connected.
-    if(r->odrives.empty()) return;
-    odrive = r->odrives[0];
+    if((int)r->odrives.size() <= odrive_index) return;
+    odrive = r->odrives[odrive_index];
 
     std::cout << "Input voltage is " << odrive->inputVoltage() << std::endl;
     
@@ -228,33 +681,147 @@ void Controller::signalHandler(int s)
 
 void Controller::stopMotors()
 {
+    if(plant) return;
+
     odrive->m0->disable();
     odrive->m1->disable();
 }
 
 void Controller::createTrajectory()
 {
-    initial_state << odrive->m0->getPosEstimateInRad(), odrive->m1->getPosEstimateInRad(),
-    odrive->m0->getVelEstimateInRads(),odrive->m1->getVelEstimateInRads();
+    readState(initial_state);
 
-    problem->set_x0(initial_state);
-    solver->solve(crocoddyl::DEFAULT_VECTOR, crocoddyl::DEFAULT_VECTOR, trajectory_solver_iterations, false, 1e-9);
-    
-    trajectory_xs = solver->get_xs();
-    trajectory_us = solver->get_us();
+    const bool cached = startup_cache && startup_cache->isValid() && startup_cache->get_trajectory_xs().size() == (std::size_t)T_ROUTE;
+
+    if(cached && (initial_state - startup_cache->get_initial_state()).lpNorm<Eigen::Infinity>() < startup_cache_state_tolerance)
+    {
+        //Close enough to the state the cached trajectory starts from, the MPC absorbs the difference.
+        trajectory_xs = startup_cache->get_trajectory_xs();
+        trajectory_us = startup_cache->get_trajectory_us();
+        std::cout << "Trajectory restored from the startup cache." << std::endl;
+    }else{
+        problem->set_x0(initial_state);
+        if(cached){
+            std::vector<Eigen::VectorXd> init_xs = startup_cache->get_trajectory_xs();
+            init_xs[0] = initial_state;
+            solver->solve(init_xs, startup_cache->get_trajectory_us(), trajectory_solver_iterations, false, 1e-9);
+        }else if(trajectory_continuation_stages > 1){
+            solveTrajectoryContinuation();
+        }else{
+            solver->solve(crocoddyl::DEFAULT_VECTOR, crocoddyl::DEFAULT_VECTOR, trajectory_solver_iterations, false, 1e-9);
+        }
+
+        trajectory_xs = solver->get_xs();
+        trajectory_us = solver->get_us();
+
+        if(startup_cache && solver->get_is_feasible())
+            startup_cache->save(getTunableParameters(), initial_state, trajectory_xs, trajectory_us);
+    }
     
     std::cout << "Trajectory generated! It has xs: " << trajectory_xs.size() << " and us: " << trajectory_us.size() << std::endl;
+    std::cout << "Ready " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - construction_time).count()
+    << "ms after startup." << std::endl;
 
     //Assign the reference thetas from the trajectory to the RealTime MPC
+    setGoalReference(trajectory_xs[T_MPC - 1]);
+}
+
+//Torque bounds scaled from the configured ones and the terminal goal weight of the trajectory problem.
+void Controller::setTrajectoryStage(double torque_scale, double terminal_weight)
+{
+    const Eigen::VectorXd stage_ub = torque_scale * torque_limit_ub;
+    const Eigen::VectorXd stage_lb = torque_scale * torque_limit_lb;
+
+    for(std::size_t i = 0; i < differential_models_running.size(); i++){
+        differential_models_running[i]->set_u_ub(stage_ub);
+        differential_models_running[i]->set_u_lb(stage_lb);
+        integrated_models_running[i]->set_u_ub(stage_ub);
+        integrated_models_running[i]->set_u_lb(stage_lb);
+    }
+    differential_terminal_model->set_u_ub(stage_ub);
+    differential_terminal_model->set_u_lb(stage_lb);
+
+    setCostWeight(terminal_cost_model_sum, "x_goal", terminal_weight);
+}
+
+//Stage k of K solves with s = (k - 1) / (K - 1): the bounds are widened by a factor that goes linearly
+//from the relaxation at the first stage to 1 at the last one, and the terminal weight geometrically from
+//weight_ratio times the final one to it. Every stage starts from the previous solution, the last one is
+//the configured problem. A single stage solves the configured problem directly.
+void Controller::solveTrajectoryContinuation()
+{
+    double direct_time = 0, direct_cost = 0;
+    long direct_iterations = 0;
+
+    if(trajectory_continuation_compare)
+    {
+        auto start = std::chrono::steady_clock::now();
+        solver->solve(crocoddyl::DEFAULT_VECTOR, crocoddyl::DEFAULT_VECTOR, trajectory_solver_iterations, false, 1e-9);
+        direct_time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        direct_iterations = solver->get_iter() + 1;
+        direct_cost = solver->get_cost();
+    }
+
+    std::vector<Eigen::VectorXd> stage_xs, stage_us;
+    long iterations = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for(int stage = 1; stage <= trajectory_continuation_stages; stage++)
+    {
+        const double s = trajectory_continuation_stages > 1 ? (double)(stage - 1) / (trajectory_continuation_stages - 1) : 1;
+        const double torque_scale = trajectory_continuation_torque_relaxation + (1 - trajectory_continuation_torque_relaxation) * s;
+        const double terminal_weight = trajectory_terminal_weight * std::pow(trajectory_continuation_weight_ratio, 1 - s);
+        const int stage_iterations = stage == trajectory_continuation_stages ? trajectory_solver_iterations : trajectory_continuation_iterations;
+
+        setTrajectoryStage(torque_scale, terminal_weight);
+        if(stage == 1) solver->solve(crocoddyl::DEFAULT_VECTOR, crocoddyl::DEFAULT_VECTOR, stage_iterations, false, 1e-9);
+        else solver->solve(stage_xs, stage_us, stage_iterations, false, 1e-9);
+
+        iterations += solver->get_iter() + 1;
+        stage_xs = solver->get_xs();
+        stage_us = solver->get_us();
+
+        std::cout << "Continuation stage " << stage << ": torque x" << torque_scale << ", terminal weight " << terminal_weight
+        << ", " << solver->get_iter() + 1 << " iterations, cost " << solver->get_cost() << std::endl;
+    }
+
+    const double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Continuation: " << iterations << " iterations in " << time << "ms, cost " << solver->get_cost() << std::endl;
+    if(trajectory_continuation_compare)
+        std::cout << "Direct solve: " << direct_iterations << " iterations in " << direct_time << "ms, cost " << direct_cost << std::endl;
+}
+
+//Sets the goal of every node of the MPC problem, running and terminal.
+void Controller::setGoalReference(const Eigen::Ref<const Eigen::VectorXd>& x_ref)
+{
     for(int node_index = 0; node_index < T_MPC - 1; node_index++)
     {
-       boost::static_pointer_cast<CostModelDoublePendulum>(differential_models_running[node_index]->get_costs()->get_costs().find("x_goal")->second->cost)
-       ->setReference(trajectory_xs[T_MPC - 1][0], trajectory_xs[T_MPC - 1][1],trajectory_xs[T_MPC - 1][2], trajectory_xs[T_MPC - 1][3]);
+       boost::static_pointer_cast<CostModelPendulumTpl<double, NJoints>>(differential_models_running[node_index]->get_costs()->get_costs().find("x_goal")->second->cost)
+       ->setReference(x_ref);
     }
     
     //Node terminal
-    boost::static_pointer_cast<CostModelDoublePendulum>(differential_terminal_model->get_costs()->get_costs().find("x_goal")->second->cost)
-       ->setReference(trajectory_xs[T_MPC - 1][0], trajectory_xs[T_MPC - 1][1],trajectory_xs[T_MPC - 1][2], trajectory_xs[T_MPC - 1][3]);
+    boost::static_pointer_cast<CostModelPendulumTpl<double, NJoints>>(differential_terminal_model->get_costs()->get_costs().find("x_goal")->second->cost)
+       ->setReference(x_ref);
+
+    if(float_mppi_solver){
+        float_goal = x_ref.cast<float>();
+        float_x_goal_cost->setReference(float_goal);
+    }
+
+    //Only a new reference makes the gains stale. A replay sets the recorded one every tick and
+    //has to reuse gains exactly where the live run did.
+    if(x_ref != goal_reference)
+    {
+        goal_reference = x_ref;
+        invalidateGains();
+    }
+}
+
+void Controller::invalidateGains()
+{
+    for(auto const& early_stop_solver: early_stop_solvers)
+        early_stop_solver->invalidateGains();
 }
 
 void Controller::executeTrajectoryOpenLoop(){
@@ -263,195 +830,798 @@ void Controller::executeTrajectoryOpenLoop(){
     std::cout << "Ended trajectory! " << std::endl;
 }
 
-void Controller::controlLoop()    
+//Simulation only: the plant replaces the ODrive reads and writes. x0 is where it starts.
+void Controller::connectSimulatedPlant(const Eigen::VectorXd& x0)
 {
-    /*
-    long iteration = 0;
-    
-    
-    int time_skips = 0;
+    plant = boost::make_shared<SimulatedPlant>(state, actuation_model, x0, dt / 10);
+}
 
-    int i = 0, j = 0;
-    int iter_after_xt = 0;
-    float elapsedTime = 0, torque = 0;
-    int warmStartIndex = 0;
-    
+void Controller::readState(Eigen::VectorXd& x)
+{
+    if(plant){
+        plant->readState(x);
+        return;
+    }
 
-    bool fa = true;
-    bool fb = true;
+    x << odrive->m0->getPosEstimateInRad(), odrive->m1->getPosEstimateInRad(),
+    odrive->m0->getVelEstimateInRads(),odrive->m1->getVelEstimateInRads();
+}
 
-    //this->startGraphsThread();
+void Controller::applyTorque(const Eigen::VectorXd& u)
+{
+    if(plant){
+        plant->step(u, dt);
+        return;
+    }
 
-    while(!signalFlag){
-        
-        auto start = std::chrono::high_resolution_clock::now();
-        
-        initial_state[0] = odrive->m0->getPosEstimateInRad();
-        initial_state[1] = odrive->m0->getVelEstimateInRads();
-        
-        //Safety check
-        if(initial_state[1] > 25 || initial_state[1] < -25) 
-        {
-            std::cout << "Speed limit reached!" << std::endl;
-            break;
-        }
+    odrive->m0->setTorque(u[0]);
+    odrive->m1->setTorque(u[1]);
+}
 
-        problem->set_x0(initial_state);
-        solver->solve(mpc_warmStart_xs, mpc_warmStart_us, mpc_solver_iterations, false, 1e-9);
-        
+bool Controller::isSwungUp(const Eigen::VectorXd& x)
+{
+    //Upright is q = 0, so wrap the angles to [-pi, pi] before comparing.
+    for(int i = 0; i < state->get_nq(); i++){
+        if(std::abs(std::remainder(x[i], 2 * M_PI)) > swing_up_tolerance) return false;
+    }
+    return true;
+}
 
-        torque = solver->get_us()[0][0];
-        odrive->m0->setTorque(torque);
-        
-        //Prepare next warm start.
-        if(warmStartIndex > T_ROUTE - T_MPC - 2){
-            
-            if(fa){
-                std::cout << "End of carrot. Starting progressively RailMPC. " << iteration  << " WarmStartIndex is " << warmStartIndex << std::endl;
-                fa = false;
-            }
+//What the early stop solver skipped on its last solve, a plain Box-FDDP always solves in full.
+static early_stop_outcome solveOutcome(const crocoddyl::SolverBoxFDDP& solver)
+{
+    const SolverEarlyStop *early_stop_solver = dynamic_cast<const SolverEarlyStop*>(&solver);
+    return early_stop_solver ? early_stop_solver->get_last_outcome() : FULL_SOLVE;
+}
 
-            if(iter_after_xt < T_MPC - 1){
-                //Entering Rail MPC progressively
-                
-                iter_after_xt++;
-                //Prepare the warmStart vectors:
-                mpc_warmStart_xs = { trajectory_xs.begin() + warmStartIndex + iter_after_xt, trajectory_xs.begin() + warmStartIndex + T_MPC};
-                mpc_warmStart_us = { trajectory_us.begin() + warmStartIndex + iter_after_xt, trajectory_us.begin() + warmStartIndex + T_MPC};
-
-                //Append the new data.
-                auto xs = solver->get_xs();
-                auto us = solver->get_us();
-
-                mpc_warmStart_xs.insert(mpc_warmStart_xs.end(), xs.end() - iter_after_xt , xs.end());
-                mpc_warmStart_us.insert(mpc_warmStart_us.end(), us.end() - iter_after_xt , us.end());
-
-                //Remove the terminal reference only once!
-                if(iter_after_xt == 1){
-                    auto cost_model_sum = differential_terminal_model->get_costs()->get_costs();
-                   
-                    auto goal_cost = boost::static_pointer_cast<CostModelDoublePendulum>(cost_model_sum.find("x_goal")->second->cost);
-                    auto reg_x_cost = boost::static_pointer_cast<crocoddyl::CostModelState>(cost_model_sum.find("x_reg")->second->cost);
-                    auto reg_u_cost = boost::static_pointer_cast<crocoddyl::CostModelControl>(cost_model_sum.find("u_reg")->second->cost);
-                    
-                    goal_cost->setReference(0);
-                    reg_x_cost->set_xref(state->zero());
-                    reg_u_cost->set_uref((Eigen::VectorXd::Zero(state->get_nv())));   
-                }else{
-                    //Remove the references from the last iteration terminal cost.
-                    auto cost_model_sum = differential_models_running[T_MPC - iter_after_xt]->get_costs()->get_costs();
-                   
-                    auto goal_cost = boost::static_pointer_cast<CostModelDoublePendulum>(cost_model_sum.find("x_goal")->second->cost);
-                    auto reg_x_cost = boost::static_pointer_cast<crocoddyl::CostModelState>(cost_model_sum.find("x_reg")->second->cost);
-                    auto reg_u_cost = boost::static_pointer_cast<crocoddyl::CostModelControl>(cost_model_sum.find("u_reg")->second->cost);
-                    
-                    goal_cost->setReference(0);
-                    reg_x_cost->set_xref(state->zero());
-                    reg_u_cost->set_uref((Eigen::VectorXd::Zero(state->get_nv())));
-                }
+void Controller::computeControl(const Eigen::VectorXd& x0, Eigen::VectorXd& u)
+{
+    last_solve_outcome = FULL_SOLVE;
 
-                //Update all the nodes references.
-                for(int node_index = 0; node_index <= T_MPC - iter_after_xt - 1; node_index++)
-                {
-                    auto cost_model_sum = differential_models_running[node_index]->get_costs()->get_costs();
-                    auto goal_cost = boost::static_pointer_cast<CostModelDoublePendulum>(cost_model_sum.find("x_goal")->second->cost);
-                    auto reg_x_cost = boost::static_pointer_cast<crocoddyl::CostModelState>(cost_model_sum.find("x_reg")->second->cost);
-                    auto reg_u_cost = boost::static_pointer_cast<crocoddyl::CostModelControl>(cost_model_sum.find("u_reg")->second->cost);
-                
-                    Eigen::VectorXd state = mpc_warmStart_xs[node_index];
-                    goal_cost->setReference(state[0]);
-                    reg_x_cost->set_xref(state);
-                    reg_u_cost->set_uref(mpc_warmStart_us[node_index]);   
-                }
+    if(lqr && lqr->update(x0))
+    {
+        lqr->computeControl(x0, u);
+        lqr_ticks++;
+        last_control_source = LQR_SOURCE;
+        last_solve_iterations = 0;
+        last_solve_cost = lqr->costToGo(x0);
+        mpc_warm_start_valid = false;
+        return;
+    }
 
-                //Make the last node terminal by changing its weight.
-                differential_models_running[T_MPC - iter_after_xt - 1]->get_costs()->get_costs().find("x_goal")->second->weight = trajectory_terminal_weight;   
-                
-            }else{
-                    
-                if(fb){
-                    std::cout << "All costs are terminal" << iteration << std::endl;
-                    //Remove the references from the first node (Last One to become Full Rail)
-                    auto cost_model_sum = differential_models_running[0]->get_costs()->get_costs();
-                   
-                    auto goal_cost = boost::static_pointer_cast<CostModelDoublePendulum>(cost_model_sum.find("x_goal")->second->cost);
-                    auto reg_x_cost = boost::static_pointer_cast<crocoddyl::CostModelState>(cost_model_sum.find("x_reg")->second->cost);
-                    auto reg_u_cost = boost::static_pointer_cast<crocoddyl::CostModelControl>(cost_model_sum.find("u_reg")->second->cost);
-                    
-                    goal_cost->setReference(0);
-                    reg_x_cost->set_xref(state->zero());
-                    reg_u_cost->set_uref((Eigen::VectorXd::Zero(state->get_nv())));
-                    fb = false;
-                }
+    if(config_controller_mode == POLICY_MODE && policy->computeControl(x0, u))
+    {
+        policy_ticks++;
+        last_control_source = POLICY_SOURCE;
+        last_solve_iterations = 0;
+        last_solve_cost = 0;
+        mpc_warm_start_valid = false;
+        return;
+    }
+
+    //Back to MPC: the shifted warm start is stale, restart it from the measured state.
+    if(!mpc_warm_start_valid){
+        std::fill(mpc_warmStart_xs.begin(), mpc_warmStart_xs.end(), x0);
+        std::fill(mpc_warmStart_us.begin(), mpc_warmStart_us.end(), u);
+        if(scenario_mpc) scenario_mpc->resetWarmStart();
+        //The warm start starts at x0, the gains of the last MPC tick would always look current.
+        invalidateGains();
+        mpc_warm_start_valid = true;
+    }
+
+    problem->set_x0(x0);
 
-                // All costs are terminal
-                mpc_warmStart_xs = solver->get_xs();
-                mpc_warmStart_us = solver->get_us();
-              
-                if(control_loop_iterations > 0 && ++j >= control_loop_iterations)
-                    break;
+    const std::vector<Eigen::VectorXd> *xs;
+    const std::vector<Eigen::VectorXd> *us;
+
+    switch(config_controller_mode){
+        case SCENARIO_MODE:
+        {
+            const int iterations = scheduler ? scheduler->get_iterations() : mpc_solver_iterations;
+            scenario_mpc->solve(x0, mpc_warmStart_xs, mpc_warmStart_us, iterations);
+            xs = &scenario_mpc->get_xs();
+            us = &scenario_mpc->get_us();
+            last_solve_iterations = iterations;
+            last_solve_cost = scenario_mpc->get_cost();
+            last_solve_converged = false;
+        }
+        break;
+
+        case MPPI_MODE:
+        {
+            const int iterations = scheduler ? scheduler->get_iterations() : mpc_solver_iterations;
+            if(float_mppi_solver)
+            {
+                //Solved in float, the warm start and the solution stay in double.
+                float_x0 = x0.cast<float>();
+                float_problem->set_x0(float_x0);
+                for(std::size_t t = 0; t < float_warm_start_us.size(); t++)
+                    float_warm_start_us[t] = mpc_warmStart_us[t].cast<float>();
+
+                float_mppi_solver->solve(float_warm_start_us, iterations);
+
+                for(std::size_t t = 0; t < float_solution_xs.size(); t++)
+                    float_solution_xs[t] = float_mppi_solver->get_xs()[t].cast<double>();
+                for(std::size_t t = 0; t < float_solution_us.size(); t++)
+                    float_solution_us[t] = float_mppi_solver->get_us()[t].cast<double>();
+
+                xs = &float_solution_xs;
+                us = &float_solution_us;
+                last_solve_iterations = iterations;
+                last_solve_cost = float_mppi_solver->get_cost();
+                last_solve_converged = false;
+                break;
             }
-            
-        }else{
+            mppi_solver->solve(mpc_warmStart_us, iterations);
+            xs = &mppi_solver->get_xs();
+            us = &mppi_solver->get_us();
+            last_solve_iterations = iterations;
+            last_solve_cost = mppi_solver->get_cost();
+            last_solve_converged = false;
+        }
+        break;
 
-            warmStartIndex++;
-            //Carrot MPC
-            mpc_warmStart_xs = { trajectory_xs.begin() + warmStartIndex, trajectory_xs.begin() + warmStartIndex + T_MPC};
-            mpc_warmStart_us = { trajectory_us.begin() + warmStartIndex, trajectory_us.begin() + warmStartIndex + T_MPC};
-            
-            for(int node_index = 0; node_index < T_MPC - 1; node_index++)
+        //The policy falls back to FDDP when it is not confident.
+        default:
+        case POLICY_MODE:
+        case FDDP_MODE:
+            if(condensed_solver)
             {
-                auto cost_model_sum = differential_models_running[node_index]->get_costs()->get_costs();
-                auto goal_cost = boost::static_pointer_cast<CostModelDoublePendulum>(cost_model_sum.find("x_goal")->second->cost);
-                auto reg_x_cost = boost::static_pointer_cast<crocoddyl::CostModelState>(cost_model_sum.find("x_reg")->second->cost);
-                auto reg_u_cost = boost::static_pointer_cast<crocoddyl::CostModelControl>(cost_model_sum.find("u_reg")->second->cost);
-                
-                Eigen::VectorXd state = mpc_warmStart_xs[node_index];
-                goal_cost->setReference(state[0]);
-                reg_x_cost->set_xref(state);
-                reg_u_cost->set_uref(mpc_warmStart_us[node_index]);
+                const int iterations = scheduler ? scheduler->get_iterations() : mpc_solver_iterations;
+                last_solve_converged = condensed_solver->solve(mpc_warmStart_us, iterations);
+                xs = &condensed_solver->get_xs();
+                us = &condensed_solver->get_us();
+                last_solve_iterations = condensed_solver->get_iter();
+                last_solve_cost = condensed_solver->get_cost();
             }
-        
-            //Node terminal
-            auto cost_model_sum = differential_terminal_model->get_costs()->get_costs();
-            auto goal_cost = boost::static_pointer_cast<CostModelDoublePendulum>(cost_model_sum.find("x_goal")->second->cost);
-            auto reg_x_cost = boost::static_pointer_cast<crocoddyl::CostModelState>(cost_model_sum.find("x_reg")->second->cost);
-            auto reg_u_cost = boost::static_pointer_cast<crocoddyl::CostModelControl>(cost_model_sum.find("u_reg")->second->cost);    
-
-            Eigen::VectorXd state = mpc_warmStart_xs[T_MPC - 1];
-            goal_cost->setReference(state[0]);
-            reg_x_cost->set_xref(state);
-            reg_u_cost->set_uref(mpc_warmStart_us[T_MPC - 1]);
+            else if(scheduler)
+            {
+                //The warm start is kept at the full horizon, the active level takes its first nodes.
+                const int level = scheduler->get_level();
+                crocoddyl::SolverBoxFDDP &level_solver = *horizon_solvers[level];
+
+                //A level that sat idle still holds the gains of the last tick it solved.
+                if(level != active_horizon_level){
+                    invalidateGains();
+                    active_horizon_level = level;
+                }
+                std::vector<Eigen::VectorXd> &level_xs = horizon_warm_start_xs[level];
+                std::vector<Eigen::VectorXd> &level_us = horizon_warm_start_us[level];
+
+                std::copy(mpc_warmStart_xs.begin(), mpc_warmStart_xs.begin() + level_xs.size(), level_xs.begin());
+                std::copy(mpc_warmStart_us.begin(), mpc_warmStart_us.begin() + level_us.size(), level_us.begin());
+
+                level_solver.get_problem()->set_x0(x0);
+                last_solve_converged = level_solver.solve(level_xs, level_us, scheduler->get_iterations(), false, 1e-9);
+                xs = &level_solver.get_xs();
+                us = &level_solver.get_us();
+                last_solve_iterations = level_solver.get_iter();
+                last_solve_cost = level_solver.get_cost();
+                last_solve_outcome = solveOutcome(level_solver);
+
+                //A last step that barely moved the cost counts as converged too.
+                if(std::abs(level_solver.get_dV()) < adaptive_cost_tolerance * std::abs(last_solve_cost))
+                    last_solve_converged = true;
+            }else{
+                last_solve_converged = solver->solve(mpc_warmStart_xs, mpc_warmStart_us, mpc_solver_iterations, false, 1e-9);
+                xs = &solver->get_xs();
+                us = &solver->get_us();
+                last_solve_iterations = solver->get_iter();
+                last_solve_cost = solver->get_cost();
+                last_solve_outcome = solveOutcome(*solver);
+            }
+        break;
+    }
+
+    last_control_source = MPC_SOURCE;
+    u = (*us)[0];
+
+    //Shift the solution one node to warm start the next tick. The last node is repeated up to
+    //the full horizon, so a longer level can start from it too.
+    std::fill(std::copy(xs->begin() + 1, xs->end(), mpc_warmStart_xs.begin()), mpc_warmStart_xs.end(), xs->back());
+    std::fill(std::copy(us->begin() + 1, us->end(), mpc_warmStart_us.begin()), mpc_warmStart_us.end(), us->back());
+}
+
+static double steadySeconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//Returns false when the measured state is out of the limits and the motors should stop.
+bool Controller::controlTick()
+{
+    AllocationScope allocations;
+    AllocationTracker::setEigenMallocAllowed(!forbid_eigen_malloc);
+
+    bool keep_running = runControlTick();
+
+    AllocationTracker::setEigenMallocAllowed(true);
+    tick_allocations = allocations.allocations();
+    return keep_running;
+}
+
+//Heap allocations made by the last controlTick, on any thread.
+long Controller::getTickAllocations()
+{
+    return tick_allocations;
+}
+
+//With EIGEN_RUNTIME_NO_MALLOC defined, Eigen asserts on any allocation inside controlTick.
+void Controller::setForbidEigenMalloc(bool forbid)
+{
+    forbid_eigen_malloc = forbid;
+}
+
+#if USE_GRAPHS
+//Motor k drives joint NJoints - 1 - k, the datasets are named after the motors.
+static std::string motorDataset(const std::string& name, int motor)
+{
+    return name + " m" + std::to_string(motor);
+}
+
+template<int NJoints>
+static void appendInitialGraphs(Graph_Logger* graph_logger, const std::vector<Motor*>& motors,
+                                const std::vector<Eigen::VectorXd>& xs, const std::vector<Eigen::VectorXd>& us)
+{
+    for(auto const& x: xs)
+    {
+        for(int k = 0; k < NJoints; k++){
+            graph_logger->appendToBuffer(motorDataset("Crocoddyl initial calculated position", k), x[NJoints - 1 - k]);
+            graph_logger->appendToBuffer(motorDataset("Crocoddyl initial calculated velocity", k), x[2 * NJoints - 1 - k]);
         }
+    }
 
-        #if USE_GRAPHS
-        graph_logger->appendToBuffer("computed currents", odrive->m0->castTorqueToCurrent(torque));
-        graph_logger->appendToBuffer("computed positions", solver->get_xs()[0][0]);
-        graph_logger->appendToBuffer("computed next positions", solver->get_xs()[1][0]);
+    for(auto const& u: us)
+    {
+        for(int k = 0; k < NJoints; k++)
+            graph_logger->appendToBuffer(motorDataset("Crocoddyl initial calculated current", k), motors[k]->castTorqueToCurrent(u[NJoints - 1 - k]));
+    }
+}
+
+template<int NJoints>
+static std::vector<std::string> graphDatasets()
+{
+    const std::vector<std::string> names = {
+        "Crocoddyl initial calculated position",
+        "Crocoddyl initial calculated velocity",
+        "Crocoddyl initial calculated current",
+        "computed currents",
+        "ODrive real position",
+        "ODrive real velocity",
+        "ODrive real current"};
+
+    std::vector<std::string> datasets;
+    for(auto const& name: names)
+        for(int k = 0; k < NJoints; k++)
+            datasets.push_back(motorDataset(name, k));
+    return datasets;
+}
+
+template<int NJoints>
+static void plotGraphs(Graph_Logger* graph_logger)
+{
+    for(int k = 0; k < NJoints; k++){
+        std::vector<std::string> datasets = {motorDataset("Crocoddyl initial calculated position", k),
+        motorDataset("ODrive real position", k)};
+        graph_logger->plot(motorDataset("Positions", k), datasets,"dt","rad", false, false);
+    }
 
-        graph_logger->appendToBuffer("computed next control", odrive->m0->castTorqueToCurrent(solver->get_us()[1][0]));
+    for(int k = 0; k < NJoints; k++){
+        std::vector<std::string> datasets = {motorDataset("Crocoddyl initial calculated velocity", k),
+        motorDataset("ODrive real velocity", k)};
+        graph_logger->plot(motorDataset("Velocities", k), datasets,"dt","rad", false, false);
+    }
+
+    for(int k = 0; k < NJoints; k++){
+        std::vector<std::string> datasets = {motorDataset("Crocoddyl initial calculated current", k),
+        motorDataset("computed currents", k),
+        motorDataset("ODrive real current", k)};
+        graph_logger->plot(motorDataset("Currents", k), datasets,"dt","Amps", false, false);
+    }
+}
+#endif
+
+bool Controller::runControlTick()
+{
+    if(!beginTick())
+        return false;
+
+    //Stamp the measurement in the middle of the USB reads.
+    double t_read = steadySeconds();
+    readState(measured_state);
+    double t_measurement = 0.5 * (t_read + steadySeconds());
+
+    double solve_time = solveTick(t_measurement);
+
+    //Actuate first, the bookkeeping below is off the sensing to actuation path.
+    applyTorque(mpc_torque);
+    if(state_estimator) state_estimator->setAppliedControl(steadySeconds(), mpc_torque);
+
+    return finishTick(t_measurement, solve_time);
+}
+
+//Config reload and supervisor commands, false when the supervisor asked to stop.
+bool Controller::beginTick()
+{
+    if(config_watcher && config_watcher->poll(reloaded_parameters))
+    {
+        applyTunableParameters(reloaded_parameters);
+        if(session_recorder) session_recorder->writeParameters(reloaded_parameters);
+    }
+
+    //A single atomic load when there is no new command.
+    if(supervisor && supervisor->poll(supervisor_command) && !applySupervisorCommand(supervisor_command))
+        return false;
+    return true;
+}
+
+//Estimators and solve from measured_state, taken at t_measurement. Leaves the torque in
+//mpc_torque and returns the solve time in us.
+double Controller::solveTick(double t_measurement)
+{
+    if(parameter_estimator && odrive)
+    {
+        //The current commanded on the last tick is the one that acted until now.
+        motor_currents << odrive->m0->castTorqueToCurrent(mpc_torque[0]), odrive->m1->castTorqueToCurrent(mpc_torque[1]);
+        updateParameterEstimate(t_measurement, measured_state, motor_currents);
+    }
+
+    if(state_estimator)
+    {
+        //Start the solve from where the pendulum will be when its torque reaches the motors.
+        state_estimator->update(t_measurement, measured_state);
+        state_estimator->predict(steadySeconds() + expected_solve_time + actuation_latency, initial_state);
+    }else{
+        initial_state = measured_state;
+    }
+
+    if(session_recorder)
+    {
+        //Everything computeControl reads besides the problem itself. Same sizes, so these copies do not allocate.
+        SessionTick &record = *session_tick;
+        record.tick = tick_count;
+        record.t = t_measurement;
+        record.measured_state = measured_state;
+        record.x0 = initial_state;
+        x_goal_cost->getReference(record.goal_reference);
+        std::copy(mpc_warmStart_xs.begin(), mpc_warmStart_xs.end(), record.warm_start_xs.begin());
+        std::copy(mpc_warmStart_us.begin(), mpc_warmStart_us.end(), record.warm_start_us.begin());
+        record.warm_start_valid = mpc_warm_start_valid;
+        record.previous_torque = mpc_torque;
+        record.horizon_level = scheduler ? scheduler->get_level() : 0;
+        record.iteration_cap = scheduler ? scheduler->get_iterations() : mpc_solver_iterations;
+        session_recorder->writeTickInput(record);
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    computeControl(initial_state, mpc_torque);
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+//Bookkeeping once the torque is on its way, whoever writes it reports the write time to the
+//state estimator. Returns false when the measured state is out of
+//the limits and the motors should stop.
+bool Controller::finishTick(double t_measurement, double solve_time)
+{
+    if(state_estimator)
+        expected_solve_time = 0.9 * expected_solve_time + 0.1 * solve_time * 1e-6;
+
+    if(scheduler && last_control_source == MPC_SOURCE)
+        scheduler->update(solve_time * 1e-6, last_solve_converged);
+
+    if(session_recorder)
+    {
+        SessionTick &record = *session_tick;
+        record.torque = mpc_torque;
+        record.solve_time = solve_time;
+        record.iterations = last_solve_iterations;
+        record.cost = last_solve_cost;
+        record.source = last_control_source;
+        session_recorder->writeTickOutput(record);
+    }
+
+    if(telemetry)
+    {
+        telemetry_frame.tick = tick_count;
+        telemetry_frame.t = t_measurement;
+        Eigen::Map<Eigen::Vector4d>(telemetry_frame.measured_state) = measured_state;
+        Eigen::Map<Eigen::Vector4d>(telemetry_frame.x0) = initial_state;
+        Eigen::Map<Eigen::Vector2d>(telemetry_frame.torque) = mpc_torque;
+        telemetry_frame.cost = last_solve_cost;
+        telemetry_frame.solve_time = solve_time;
+        telemetry_frame.iterations = last_solve_iterations;
+        telemetry_frame.source = last_control_source;
+        telemetry_frame.solve_outcome = last_solve_outcome;
+        telemetry->publish(telemetry_frame);
+    }
+
+    if(supervisor)
+        supervisor->publish(tick_count, t_measurement, measured_state, initial_state, mpc_torque, last_solve_cost, solve_time,
+                            last_solve_iterations, last_control_source, supervisor_active_mode, mpc_warmStart_xs, mpc_warmStart_us);
+
+    solve_time_sum += solve_time;
+    solve_time_max = std::max(solve_time_max, solve_time);
+
+    if(swing_up_tick < 0 && isSwungUp(measured_state))
+        swing_up_tick = tick_count;
+    tick_count++;
+
+    #if USE_GRAPHS
+    if(graph_logger && odrive)
+    {
+        const std::vector<Motor*> motors = {odrive->m0, odrive->m1};
+        for(int k = 0; k < NJoints; k++)
+            graph_logger->appendToBuffer(motorDataset("computed currents", k), motors[k]->castTorqueToCurrent(mpc_torque[k]));
+    }
+    #endif
+
+    //Safety check. The solver already plans inside the limits, this only catches a clear overshoot.
+    if(isOutOfLimits(measured_state))
+    {
+        std::cout << "State limit reached! " << measured_state.transpose() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+//Returns false when the supervisor asked to stop.
+bool Controller::applySupervisorCommand(const SupervisorCommand& command)
+{
+    switch(command.mode){
+        case SUPERVISOR_STOP:
+            std::cout << "Stop requested by the supervisor." << std::endl;
+            return false;
+
+        case SUPERVISOR_SWING_UP:
+            setGoalReference(trajectory_xs[T_MPC - 1]);
+            std::copy(trajectory_xs.begin(), trajectory_xs.begin() + mpc_warmStart_xs.size(), mpc_warmStart_xs.begin());
+            std::copy(trajectory_us.begin(), trajectory_us.begin() + mpc_warmStart_us.size(), mpc_warmStart_us.begin());
+            mpc_warm_start_valid = true;
+        break;
+
+        //Upright is q = 0.
+        case SUPERVISOR_BALANCE:
+            setGoalReference(state->zero());
+        break;
+
+        default:
+        break;
+    }
+
+    if(command.mode != SUPERVISOR_NO_REQUEST) supervisor_active_mode = command.mode;
+    if(command.has_goal) setGoalReference(command.goal);
+    return true;
+}
+
+//Resets the statistics and the warm start. Call once before the first controlTick.
+void Controller::startControl()
+{
+    tick_count = 0;
+    lqr_ticks = 0;
+    policy_ticks = 0;
+    mpc_warm_start_valid = true;
+    swing_up_tick = -1;
+    solve_time_sum = 0;
+    solve_time_max = 0;
+
+    //The identification needs the ODrive torque constants and currents, replays and the
+    //simulated plant run without it.
+    if(use_online_sysid && !parameter_estimator && odrive) createParameterEstimator();
+    if(use_state_estimator) createStateEstimator();
+
+    if(!record_session_path.empty() && !session_recorder)
+    {
+        session_recorder = boost::make_shared<SessionRecorder>(record_session_path, state->get_nx(), actuation_model->get_nu(), (int)mpc_warmStart_xs.size(), dt);
+        session_tick = boost::make_shared<SessionTick>(state->get_nx(), actuation_model->get_nu(), (int)mpc_warmStart_xs.size());
+    }
 
-        graph_logger->appendToBuffer("computed velocities", solver->get_xs()[0][1]);
-        graph_logger->appendToBuffer("computed cost", solver->get_cost());
-        graph_logger->appendToBuffer("ODrive real position", initial_state[0]);
-        graph_logger->appendToBuffer("ODrive real velocity", initial_state[1]);
-        graph_logger->appendToBuffer("ODrive real current", odrive->m0->getCurrent());
+    if(!telemetry_socket_path.empty() && !telemetry)
+        telemetry = boost::make_shared<TelemetryPublisher>(telemetry_socket_path, telemetry_capacity, telemetry_batch_size, telemetry_batch_period);
+
+    supervisor_active_mode = SUPERVISOR_SWING_UP;
+    if(!supervisor_shm_name.empty() && !supervisor)
+        supervisor = boost::make_shared<SupervisorInterface>(supervisor_shm_name);
+
+    //The first ticks are warm started with the beginning of the generated trajectory.
+    std::copy(trajectory_xs.begin(), trajectory_xs.begin() + mpc_warmStart_xs.size(), mpc_warmStart_xs.begin());
+    std::copy(trajectory_us.begin(), trajectory_us.begin() + mpc_warmStart_us.size(), mpc_warmStart_us.begin());
+}
+
+//Feeds a recorded session back into computeControl, offline. Every tick gets the recorded
+//x0, goal and warm start, so the torques have to match bit for bit as long as the problem
+//was created with the same config. Call after createDOCP(false), without startControl.
+void Controller::replaySession(std::string path)
+{
+    SessionReader reader(path);
+    if(!reader.isOpen()) return;
+
+    if(reader.nx != state->get_nx() || reader.nu != actuation_model->get_nu() || reader.T != (int)mpc_warmStart_xs.size() || reader.dt != dt)
+    {
+        std::cout << "The session was recorded with nx: " << reader.nx << " nu: " << reader.nu << " T: " << reader.T
+        << " dt: " << reader.dt << ", it does not match this controller." << std::endl;
+        return;
+    }
+
+    //Never record the replay, the recording could be the file being read.
+    record_session_path.clear();
+    telemetry_socket_path.clear();
+    supervisor_shm_name.clear();
+    startControl();
+
+    SessionTick tick(reader.nx, reader.nu, reader.T);
+    TunableParameters parameters;
+    Eigen::VectorXd u(actuation_model->get_nu());
+
+    long ticks = 0;
+    long mismatches = 0;
+    long source_mismatches = 0;
+    long first_mismatch = -1;
+    double max_torque_diff = 0;
+    double recorded_time_sum = 0, recorded_time_max = 0;
+    double replay_time_sum = 0, replay_time_max = 0;
+
+    int record_type;
+    while((record_type = reader.next(tick, parameters)) != 0)
+    {
+        if(record_type == PARAMETERS_RECORD)
+        {
+            applyTunableParameters(parameters);
+            continue;
+        }
+
+        setGoalReference(tick.goal_reference);
+        std::copy(tick.warm_start_xs.begin(), tick.warm_start_xs.end(), mpc_warmStart_xs.begin());
+        std::copy(tick.warm_start_us.begin(), tick.warm_start_us.end(), mpc_warmStart_us.begin());
+        mpc_warm_start_valid = tick.warm_start_valid;
+        u = tick.previous_torque;
+        //The scheduler follows the recorded latencies, not the replay ones.
+        if(scheduler) scheduler->force(tick.horizon_level, tick.iteration_cap);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        computeControl(tick.x0, u);
+        double solve_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count();
+
+        if(std::memcmp(u.data(), tick.torque.data(), sizeof(double) * u.size()) != 0)
+        {
+            if(first_mismatch < 0) first_mismatch = tick.tick;
+            mismatches++;
+            max_torque_diff = std::max(max_torque_diff, (u - tick.torque).cwiseAbs().maxCoeff());
+        }
+        if(last_control_source != tick.source) source_mismatches++;
+
+        recorded_time_sum += tick.solve_time;
+        recorded_time_max = std::max(recorded_time_max, tick.solve_time);
+        replay_time_sum += solve_time;
+        replay_time_max = std::max(replay_time_max, solve_time);
+        ticks++;
+    }
+
+    std::cout << "Replayed " << ticks << " ticks of " << path << std::endl;
+    if(mismatches == 0)
+        std::cout << "All torques match bit for bit." << std::endl;
+    else
+        std::cout << mismatches << " torques differ, first at tick " << first_mismatch << ", max difference " << max_torque_diff << std::endl;
+    if(source_mismatches > 0)
+        std::cout << source_mismatches << " ticks used a different controller." << std::endl;
+
+    std::cout << "Solve latency recorded mean: " << recorded_time_sum / std::max(ticks, 1L) << "us max: " << recorded_time_max << "us" << std::endl
+    << "Solve latency replay mean: " << replay_time_sum / std::max(ticks, 1L) << "us max: " << replay_time_max << "us" << std::endl;
+}
+
+void Controller::printControlSummary()
+{
+    const char *mode_names[] = {"FDDP", "MPPI", "Policy", "Scenario"};
+    std::cout << mode_names[config_controller_mode] << " control loop: " << tick_count << " ticks." << std::endl
+    << "Solve latency mean: " << solve_time_sum / std::max(tick_count, 1L) << "us max: " << solve_time_max << "us" << std::endl;
+
+    if(lqr)
+        std::cout << "LQR balanced " << lqr_ticks << " of " << tick_count << " ticks." << std::endl;
+
+    printIdentifiedParameters();
+
+    if(telemetry) telemetry->printStats();
+
+    if(scheduler) scheduler->print();
+
+    for(auto const& early_stop_solver: early_stop_solvers)
+        early_stop_solver->print();
+
+    if(condensed_solver) condensed_solver->print();
+    if(scenario_mpc) scenario_mpc->print();
+
+    if(policy)
+        std::cout << "Policy used in " << policy_ticks << " of " << tick_count << " ticks." << std::endl;
+
+    if(swing_up_tick >= 0)
+        std::cout << "Swing-up reached after " << iterationsToSeconds(swing_up_tick) << "s" << std::endl;
+    else
+        std::cout << "Swing-up not reached." << std::endl;
+}
+
+void Controller::controlLoop()    
+{
+    //The simulated plant advances one dt per torque, it only makes sense one tick after the other.
+    if(pipelined_control && !plant){
+        pipelinedControlLoop();
+        return;
+    }
+
+    int time_skips = 0;
+    float elapsedTime = 0;
+
+    startControl();
+
+    while(!signalFlag){
         
-        #endif
+        auto start = std::chrono::high_resolution_clock::now();
+
+        if(!controlTick())
+            break;
+
+        if(control_loop_iterations > 0 && tick_count >= control_loop_iterations)
+            break;
 
-        iteration++;
         elapsedTime = (dt * 1000000.0f) - ((float) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - start).count());
         
         if(elapsedTime > 0){
             usleep(elapsedTime);
         }else{
             time_skips++;
-            if(time_skips >= 5){
-            std::cout << "Skipped 5 frames. Elapsed time was " << elapsedTime << std::endl;
-               // break;
+            if(time_skips % 5 == 0){
+                std::cout << "Skipped 5 frames. Elapsed time was " << elapsedTime << std::endl;
+            }
+        }
+    }
+
+    std::cout << "Skipped frames: " << time_skips << std::endl;
+    printControlSummary();
+}
+
+//Three stages on their own threads. Sensing reads the encoders on an absolute dt grid, this
+//thread solves from the newest sample and actuation writes the newest torque, so while solve k
+//runs the sample k + 1 is already being read and the torque k - 1 written. Stale samples and
+//commands are skipped, the pendulum only cares about the latest ones. A stage with an empty
+//queue sleeps on its signal, and actuation sends the write times back for the state estimator.
+void Controller::pipelinedControlLoop()
+{
+    startControl();
+
+    SPSCQueue<SensorSample> sensor_queue(pipeline_queue_capacity);
+    SPSCQueue<ActuationCommand> command_queue(pipeline_queue_capacity);
+    SPSCQueue<AppliedTorque> applied_queue(pipeline_queue_capacity);
+    QueueSignal sensor_signal;
+    QueueSignal command_signal;
+    PipelineStats stats;
+    std::atomic<bool> running(true);
+
+    //The ODrive USB link is shared by the reads and the writes.
+    std::mutex device_mutex;
+
+    auto cpu = [this](std::size_t stage){ return stage < pipeline_cpus.size() ? pipeline_cpus[stage] : -1; };
+
+    std::thread sensing([&](){
+        pinCurrentThread(cpu(0));
+        Eigen::VectorXd x(state->get_nx());
+        SensorSample sample;
+        sample.tick = 0;
+
+        timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        const long period = (long)(dt * 1e9);
+
+        while(running.load(std::memory_order_relaxed))
+        {
+            deadline.tv_nsec += period;
+            while(deadline.tv_nsec >= 1000000000L){
+                deadline.tv_nsec -= 1000000000L;
+                deadline.tv_sec++;
+            }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr);
+
+            double t_read, t_done;
+            {
+                std::lock_guard<std::mutex> lock(device_mutex);
+                t_read = steadySeconds();
+                readState(x);
+                t_done = steadySeconds();
             }
+            sample.t = 0.5 * (t_read + t_done);
+            sample.x = x;
+            stats.sense.add(t_done - t_read);
+
+            if(sensor_queue.push(sample)) sensor_signal.notify();
+            else stats.sensor_overflows++;
+            sample.tick++;
+        }
+    });
+
+    std::thread actuation([&](){
+        pinCurrentThread(cpu(2));
+        Eigen::VectorXd u(actuation_model->get_nu());
+        ActuationCommand command;
+        AppliedTorque applied;
+
+        while(running.load(std::memory_order_relaxed))
+        {
+            //Blocks instead of spinning, the timeout only bounds how late it sees running go false.
+            if(!command_queue.pop(command)){
+                command_signal.wait(0.01);
+                continue;
+            }
+            while(command_queue.pop(command)) stats.stale_commands++;
+
+            const double t_start = steadySeconds();
+            u = command.torque;
+            {
+                std::lock_guard<std::mutex> lock(device_mutex);
+                applyTorque(u);
+            }
+            const double t_applied = steadySeconds();
+
+            applied.tick = command.tick;
+            applied.t_applied = t_applied;
+            applied.torque = command.torque;
+            applied_queue.push(applied);
+
+            stats.command_queue.add(t_start - command.t_sent);
+            stats.actuate.add(t_applied - t_start);
+            stats.end_to_end.add(t_applied - command.t_measurement);
+        }
+    });
+
+    //This is the caller's thread, it gets its affinity back when the loop returns.
+    ScopedThreadPin control_pin(cpu(1));
+    SensorSample sample;
+    ActuationCommand command;
+    AppliedTorque applied;
+    Eigen::VectorXd applied_torque(actuation_model->get_nu());
+
+    while(!signalFlag)
+    {
+        if(!sensor_queue.pop(sample)){
+            sensor_signal.wait(0.01);
+            continue;
+        }
+        while(sensor_queue.pop(sample)) stats.stale_samples++;
+
+        const double t_start = steadySeconds();
+        stats.sensor_queue.add(t_start - sample.t);
+
+        if(!beginTick())
+            break;
+
+        //The torques the actuation thread wrote since the last tick, with the time they really went out.
+        while(applied_queue.pop(applied)){
+            if(!state_estimator) continue;
+            applied_torque = applied.torque;
+            state_estimator->setAppliedControl(applied.t_applied, applied_torque);
         }
-    }*/
+
+        measured_state = sample.x;
+        double solve_time = solveTick(sample.t);
+
+        command.tick = sample.tick;
+        command.t_measurement = sample.t;
+        command.torque = mpc_torque;
+        command.t_sent = steadySeconds();
+        if(command_queue.push(command)) command_signal.notify();
+        else stats.command_overflows++;
+        stats.solve.add(command.t_sent - t_start);
+
+        //The bookkeeping overlaps with the torque write.
+        if(!finishTick(sample.t, solve_time))
+            break;
+
+        if(control_loop_iterations > 0 && tick_count >= control_loop_iterations)
+            break;
+    }
+
+    running = false;
+    sensing.join();
+    actuation.join();
+
+    stats.print();
+    printControlSummary();
 }
 
 double Controller::iterationsToSeconds(int iterations)
@@ -459,6 +1629,17 @@ double Controller::iterationsToSeconds(int iterations)
     return iterations * dt;
 }
 
+double Controller::getTimeStep()
+{
+    return dt;
+}
+
+void Controller::setSolverThreads(int threads)
+{
+    mppi_threads = threads;
+    scenario_threads = threads;
+}
+
 int Controller::secondsToIterations(int seconds)
 {
     return std::ceil((double)seconds / dt);
@@ -472,41 +1653,15 @@ void Controller::initGraphs()
     #if USE_GRAPHS
     graph_logger = new Graph_Logger(dt);
 
-    //Extraiem les posicions i les comandes de torque inicials.
-    std::vector<Eigen::VectorXd> xs_eigen = solver->get_xs();
-    std::vector<Eigen::VectorXd> us_eigen = solver->get_us();
+    //Extraiem les posicions i les comandes de torque inicials. Amb la cache d'arrencada el solver no ha corregut.
+    const std::vector<Eigen::VectorXd> &xs_eigen = trajectory_xs;
+    const std::vector<Eigen::VectorXd> &us_eigen = trajectory_us;
 
-    for(auto const& x: xs_eigen)
-    {
-        graph_logger->appendToBuffer("Crocoddyl initial calculated position m0", x[1]);
-        graph_logger->appendToBuffer("Crocoddyl initial calculated position m1", x[0]);
-        graph_logger->appendToBuffer("Crocoddyl initial calculated velocity m0", x[3]);
-        graph_logger->appendToBuffer("Crocoddyl initial calculated velocity m1", x[2]);
-    }
-
-    for(auto const& u: us_eigen)
-    {
-        graph_logger->appendToBuffer("Crocoddyl initial calculated current m0", odrive->m0->castTorqueToCurrent(u[1]));
-        graph_logger->appendToBuffer("Crocoddyl initial calculated current m1", odrive->m1->castTorqueToCurrent(u[0]));
-    }
-    
+    //The ODrive drives two axes, the graphs of longer chains need their own motors.
+    appendInitialGraphs<NJoints>(graph_logger, {odrive->m0, odrive->m1}, xs_eigen, us_eigen);
 
     //Alloc memory for the graphs:
-    std::vector<std::string> datasets = {
-        "Crocoddyl initial calculated position m0",
-        "Crocoddyl initial calculated position m1",
-        "Crocoddyl initial calculated velocity m0",
-        "Crocoddyl initial calculated velocity m1",
-        "Crocoddyl initial calculated current m0",
-        "Crocoddyl initial calculated current m1",
-        "computed currents m0",
-        "computed currents m1",
-        "ODrive real position m0",
-        "ODrive real position m1",
-        "ODrive real velocity m0",
-        "ODrive real velocity m1",
-        "ODrive real current m0",
-        "ODrive real current m1"};
+    std::vector<std::string> datasets = graphDatasets<NJoints>();
 
     long additional_nodes = control_loop_iterations > 0 ? control_loop_iterations : (T_MPC + T_ROUTE) * 5;
 
@@ -539,31 +1694,7 @@ void Controller::stopGraphs()
 void Controller::showGraphs()
 {
     #if USE_GRAPHS
-    std::vector<std::string> datasets = {"Crocoddyl initial calculated position m0",
-    "ODrive real position m0"};
-    graph_logger->plot("Positions m0", datasets,"dt","rad", false, false);
-
-    datasets = {"Crocoddyl initial calculated position m1",
-    "ODrive real position m1"};
-    graph_logger->plot("Positions m1", datasets,"dt","rad", false, false);
-    
-    datasets = {"Crocoddyl initial calculated velocity m0",
-    "ODrive real velocity m0"};
-    graph_logger->plot("Velocities m0", datasets,"dt","rad", false, false);
-
-    datasets = {"Crocoddyl initial calculated velocity m1",
-    "ODrive real velocity m1"};
-    graph_logger->plot("Velocities m1", datasets,"dt","rad", false, false);
-
-    datasets = {"Crocoddyl initial calculated current m0",
-    "computed currents m0",
-    "ODrive real current m0"};
-    graph_logger->plot("Currents m0", datasets,"dt","Amps", false, false);
-
-    datasets = {"Crocoddyl initial calculated current m1",
-    "computed currents m1",
-    "ODrive real current m1"};
-    graph_logger->plot("Currents m1", datasets,"dt","Amps", false, false);
+    plotGraphs<NJoints>(graph_logger);
 
     #endif
 }
\ No newline at end of file
@@ -17,6 +17,7 @@
 #include "crocoddyl/core/solvers/ddp.hpp"
 #include "crocoddyl/core/utils/callbacks.hpp"
 #include "crocoddyl/core/activations/weighted-quadratic.hpp"
+#include "crocoddyl/core/activations/quadratic-barrier.hpp"
 
 #include "crocoddyl/multibody/fwd.hpp"
 #include "crocoddyl/multibody/actuations/multicopter-base.hpp"
@@ -31,6 +32,24 @@
 
 #include "ActuationModelDoublePendulum.h"
 #include "CostModelDoublePendulum.h"
+#include "PendulumProblem.h"
+#include "SolverMPPI.h"
+#include "LQRStabilizer.h"
+#include "ExplicitPolicy.h"
+#include "ParameterEstimator.h"
+#include "StateEstimator.h"
+#include "ConfigWatcher.h"
+#include "SessionRecorder.h"
+#include "TelemetryPublisher.h"
+#include "SupervisorInterface.h"
+#include "SolveScheduler.h"
+#include "SolverEarlyStop.h"
+#include "SolverCondensedQP.h"
+#include "ScenarioMPC.h"
+#include "StartupCache.h"
+#include "SimulatedPlant.h"
+#include "AllocationTracker.h"
+#include "ControlPipeline.h"
 
 
 #include "src/robot.h"
@@ -42,6 +61,8 @@
 
 #include <chrono>
 #include <future>
+#include <random>
+#include <cstring>
 #include <algorithm>    // std::rotate#include <algorithm>    // std::rotate
 
 #include "yaml-cpp/yaml.h"
@@ -49,13 +70,32 @@
 
 #define USE_GRAPHS true
 
+enum controller_mode{
+    FDDP_MODE = 0,
+    MPPI_MODE = 1,
+    POLICY_MODE = 2,
+    SCENARIO_MODE = 3
+};
+
+// Which controller produced the torque of a tick.
+enum control_source{
+    MPC_SOURCE = 0,
+    LQR_SOURCE = 1,
+    POLICY_SOURCE = 2
+};
+
 class Controller
 {
+public:
+    // Joints of the rig, one per ODrive axis. The problem setup and the graphs are templated
+    // on it, the ODrive reads and writes are bound to the two axes.
+    static constexpr int NJoints = 2;
+
 private:
     // Model related vars
     pinocchio::Model model;
     boost::shared_ptr<crocoddyl::StateMultibody> state;
-    boost::shared_ptr<ActuationModelDoublePendulum> actuation_model;
+    boost::shared_ptr<ActuationModelPendulumTpl<double, NJoints>> actuation_model;
 
     // Cost related vars
     boost::shared_ptr<crocoddyl::CostModelSum> running_cost_model_sum;
@@ -63,18 +103,96 @@ private:
     
     boost::shared_ptr<crocoddyl::CostModelState> x_reg_cost;
     boost::shared_ptr<crocoddyl::CostModelControl> u_reg_cost;
-    boost::shared_ptr<CostModelDoublePendulum> x_goal_cost;
+    boost::shared_ptr<crocoddyl::CostModelState> joint_limit_cost;
+    boost::shared_ptr<CostModelPendulumTpl<double, NJoints>> x_goal_cost;
 
     std::vector<boost::shared_ptr<crocoddyl::DifferentialActionModelFreeFwdDynamics>> differential_models_running;
     std::vector<boost::shared_ptr<crocoddyl::ActionModelAbstract>> integrated_models_running;
 
     boost::shared_ptr<crocoddyl::DifferentialActionModelFreeFwdDynamics> differential_terminal_model;
-    boost::shared_ptr<crocoddyl::IntegratedActionModelEuler> integrated_terminal_model;
+    boost::shared_ptr<crocoddyl::ActionModelAbstract> integrated_terminal_model;
 
     Eigen::VectorXd activation_model_weights;
 
     boost::shared_ptr<crocoddyl::ShootingProblem> problem;
     boost::shared_ptr<crocoddyl::SolverBoxFDDP> solver;
+    boost::shared_ptr<SolverMPPI> mppi_solver;
+
+    // Adaptive horizon. One problem and solver per horizon level, all sharing the running
+    // models of the full problem, with their own warm start buffers.
+    std::vector<int> adaptive_horizons;
+    int adaptive_min_iterations;
+    int adaptive_max_iterations;
+    double adaptive_budget;
+    double adaptive_high_watermark;
+    double adaptive_low_watermark;
+    int adaptive_patience;
+    double adaptive_cost_tolerance;
+    boost::shared_ptr<SolveScheduler> scheduler;
+    std::vector<boost::shared_ptr<crocoddyl::SolverBoxFDDP>> horizon_solvers;
+    std::vector<std::vector<Eigen::VectorXd>> horizon_warm_start_xs;
+    std::vector<std::vector<Eigen::VectorXd>> horizon_warm_start_us;
+    bool last_solve_converged;
+    int active_horizon_level;
+
+    // Early termination and gain reuse of the MPC solves
+    double early_stop_threshold;
+    double early_stop_gap_tolerance;
+    double gain_reuse_state_tolerance;
+    int max_gain_reuse;
+    std::vector<boost::shared_ptr<SolverEarlyStop>> early_stop_solvers;
+    Eigen::VectorXd goal_reference;
+
+    void invalidateGains();
+
+    // Condensed dense QP backend, used instead of Box-FDDP for the MPC solves when set
+    bool use_condensed_qp;
+    int condensed_qp_iterations;
+    boost::shared_ptr<SolverCondensedQP> condensed_solver;
+
+    // Scenario MPC, the MPC problem on perturbed copies of the model agreeing on u0
+    int scenario_count;
+    ScenarioSpread scenario_spread;
+    double scenario_consensus_weight;
+    int scenario_consensus_rounds;
+    int scenario_threads;
+    boost::shared_ptr<ScenarioMPC> scenario_mpc;
+
+    // Startup cache, restores the model, the weights and the trajectory of the last launch
+    boost::shared_ptr<StartupCache> startup_cache;
+    double startup_cache_state_tolerance;
+    std::chrono::steady_clock::time_point construction_time;
+
+    // Continuation of the trajectory solve: stages from relaxed torque bounds and a low
+    // terminal weight to the final ones, each warm started from the previous one
+    int trajectory_continuation_stages;
+    double trajectory_continuation_torque_relaxation;
+    double trajectory_continuation_weight_ratio;
+    int trajectory_continuation_iterations;
+    bool trajectory_continuation_compare;
+
+    void setTrajectoryStage(double torque_scale, double terminal_weight);
+    void solveTrajectoryContinuation();
+
+    // Simulated rig, used instead of the ODrive when set
+    boost::shared_ptr<SimulatedPlant> plant;
+
+    // Allocations of the last control tick
+    long tick_allocations;
+    bool forbid_eigen_malloc;
+
+    bool runControlTick();
+    bool beginTick();
+    double solveTick(double t_measurement);
+    bool finishTick(double t_measurement, double solve_time);
+
+    // Pipelined control loop: sensing, solving and actuation on their own threads joined by
+    // SPSC queues, so the tick period is bounded by the slowest stage and not their sum
+    bool pipelined_control;
+    int pipeline_queue_capacity;
+    std::vector<int> pipeline_cpus;
+
+    void pipelinedControlLoop();
 
     // Cost weights
     double x_reg_weight;
@@ -91,13 +209,92 @@ private:
     Eigen::VectorXd torque_limit_ub;
     Eigen::VectorXd torque_limit_lb;
 
+    // Joint position and velocity limits, from the URDF <limit> tags.
+    double joint_limit_weight;
+    double max_joint_velocity;
+    double joint_limit_abort_factor;
+    Eigen::VectorXd state_limit_lb;
+    Eigen::VectorXd state_limit_ub;
+
     int trajectory_solver_iterations;
     int mpc_solver_iterations;
+
+    // MPPI
+    int mppi_samples;
+    double mppi_noise_sigma;
+    double mppi_temperature;
+    int mppi_threads;
+
+    // Single precision MPPI. A float copy of the MPC problem, with the same costs and
+    // weights, that the online loop solves instead of the double one.
+    bool mppi_single_precision;
+    boost::shared_ptr<crocoddyl::StateMultibodyTpl<float>> float_state;
+    boost::shared_ptr<ActuationModelPendulumTpl<float, NJoints>> float_actuation_model;
+    boost::shared_ptr<crocoddyl::CostModelSumTpl<float>> float_running_cost_model_sum;
+    boost::shared_ptr<crocoddyl::CostModelSumTpl<float>> float_terminal_cost_model_sum;
+    boost::shared_ptr<CostModelPendulumTpl<float, NJoints>> float_x_goal_cost;
+    std::vector<boost::shared_ptr<crocoddyl::DifferentialActionModelFreeFwdDynamicsTpl<float>>> float_differential_models;
+    boost::shared_ptr<crocoddyl::ShootingProblemTpl<float>> float_problem;
+    boost::shared_ptr<SolverMPPITpl<float>> float_mppi_solver;
+    Eigen::VectorXf float_x0;
+    Eigen::VectorXf float_goal;
+    Eigen::VectorXf float_activation_weights;
+    Eigen::VectorXf float_torque_limit_lb;
+    Eigen::VectorXf float_torque_limit_ub;
+    std::vector<Eigen::VectorXf> float_warm_start_us;
+    std::vector<Eigen::VectorXd> float_solution_xs;
+    std::vector<Eigen::VectorXd> float_solution_us;
+
+    void createFloatMPPI();
+    // Weights of the MPC problem, or of the swing up one for the trajectory.
+    PendulumCostWeights costWeights(bool trajectory) const;
+    void applyFloatParameters();
+
+    // LQR balance
+    bool use_lqr_balance;
+    Eigen::VectorXd lqr_Q;
+    Eigen::VectorXd lqr_R;
+    double lqr_roa_enter;
+    double lqr_roa_exit;
+    boost::shared_ptr<LQRStabilizer> lqr;
+    long lqr_ticks;
+
+    // Explicit policy
+    std::string policy_path;
+    double policy_confidence_radius;
+    Eigen::VectorXd policy_state_scale;
+    double policy_state_noise;
+    int policy_solver_iterations;
+    boost::shared_ptr<ExplicitPolicy> policy;
+    long policy_ticks;
+    bool mpc_warm_start_valid;
+
+    // Online identification
+    bool use_online_sysid;
+    int sysid_update_period;
+    double sysid_mass_prior_std;
+    double sysid_parameter_prior_std;
+    double sysid_forgetting_factor;
+    double sysid_acceleration_filter;
+    double friction_smoothing;
+    boost::shared_ptr<ParameterEstimator> parameter_estimator;
+    Eigen::VectorXd nominal_torque_constants;
+    Eigen::VectorXd motor_currents;
+
+    // State estimation
+    bool use_state_estimator;
+    Eigen::VectorXd estimator_process_noise;
+    Eigen::VectorXd estimator_measurement_noise;
+    double estimator_max_step;
+    double actuation_latency;
+    double expected_solve_time;
+    boost::shared_ptr<StateEstimator> state_estimator;
     
     bool goto_base_position;
     bool zero_the_initial_position;
 
     Eigen::VectorXd initial_state;
+    Eigen::VectorXd measured_state;
 
 
     // Graphs
@@ -122,13 +319,54 @@ private:
     double T_ROUTE;
     double T_MPC;
 
+    // Config reload
+    bool watch_config;
+    bool docp_is_trajectory;
+    boost::shared_ptr<ConfigWatcher> config_watcher;
+    TunableParameters reloaded_parameters;
+
+    // Session recording
+    std::string record_session_path;
+    boost::shared_ptr<SessionRecorder> session_recorder;
+    boost::shared_ptr<SessionTick> session_tick;
+
+    // Live telemetry
+    std::string telemetry_socket_path;
+    int telemetry_capacity;
+    int telemetry_batch_size;
+    double telemetry_batch_period;
+    boost::shared_ptr<TelemetryPublisher> telemetry;
+    TelemetryFrame telemetry_frame;
+
+    // External supervisor
+    std::string supervisor_shm_name;
+    boost::shared_ptr<SupervisorInterface> supervisor;
+    SupervisorCommand supervisor_command;
+    int supervisor_active_mode;
+
     actuated_link config_actuated_link;
+    controller_mode config_controller_mode;
     YAML::Node config;
+    std::string config_path;
+
+    // Control loop statistics
+    Eigen::VectorXd mpc_torque;
+    double swing_up_tolerance;
+    long swing_up_tick;
+    long tick_count;
+    double solve_time_sum;
+    double solve_time_max;
+    control_source last_control_source;
+    int last_solve_iterations;
+    double last_solve_cost;
+    // Work the early stop solver skipped on this tick.
+    early_stop_outcome last_solve_outcome;
 
 public:
 
     // ODrive
     Robot *r;
+    bool owns_robot;
     ODrive *odrive;
     
     static bool signalFlag;
@@ -140,9 +378,28 @@ public:
     
     void loadModel(std::string path);
     void loadConfig(std::string configPath);
+    void loadJointLimits();
+    void setTunableParameters(const TunableParameters& parameters);
+    TunableParameters getTunableParameters() const;
+    void applyTunableParameters(const TunableParameters& parameters);
+    bool isOutOfLimits(const Eigen::VectorXd& x);
     void createDOCP(bool trajectory);
+    void createLQR();
+    void createScheduler();
+    boost::shared_ptr<crocoddyl::SolverBoxFDDP> createMPCSolver(const boost::shared_ptr<crocoddyl::ShootingProblem>& mpc_problem);
+    void loadPolicy(std::string path);
+    void buildPolicy(int samples, std::string path);
+    void createParameterEstimator();
+    void createStateEstimator();
+    void updateParameterEstimate(double t, const Eigen::VectorXd& x, const Eigen::VectorXd& currents);
+    void applyIdentifiedParameters();
+    void printIdentifiedParameters();
     void addCallbackVerbose();
     void connectODrive();
+    void connectODrive(Robot *robot, int odrive_index);
+    void connectSimulatedPlant(const Eigen::VectorXd& x0);
+    long getTickAllocations();
+    void setForbidEigenMalloc(bool forbid);
     void debugMotorAngles();
     void startGraphsThread();
     void initGraphs();
@@ -155,6 +412,16 @@ public:
     void executeTrajectoryOpenLoop();
 
     void controlLoop();
+    void startControl();
+    bool controlTick();
+    void printControlSummary();
+    void computeControl(const Eigen::VectorXd& x0, Eigen::VectorXd& u);
+    void setGoalReference(const Eigen::Ref<const Eigen::VectorXd>& x_ref);
+    bool applySupervisorCommand(const SupervisorCommand& command);
+    void replaySession(std::string path);
+    void readState(Eigen::VectorXd& x);
+    void applyTorque(const Eigen::VectorXd& u);
+    bool isSwungUp(const Eigen::VectorXd& x);
 
     void setReferences(const std::vector<Eigen::VectorXd>& state_trajectory,
                                        const std::vector<Eigen::VectorXd>& control_trajectory);
@@ -163,6 +430,9 @@ public:
                                           const Eigen::Ref<Eigen::VectorXd>& new_control);
 
     double iterationsToSeconds(int iterations);
+    double getTimeStep();
+    // Threads of the MPPI and scenario pools, overrides the config. Call it before createDOCP.
+    void setSolverThreads(int threads);
     int secondsToIterations(int seconds);
 
 
@@ -5,72 +5,74 @@
 #include "CostModelDoublePendulum.h"
 
 
-CostModelDoublePendulum::CostModelDoublePendulum(const boost::shared_ptr<crocoddyl::StateMultibody> &state,
-                                                 const boost::shared_ptr<crocoddyl::ActivationModelAbstract> &activation,
-                                                 const size_t &nu) : CostModelAbstractTpl(state, activation, nu) 
+template<typename Scalar, int NJoints>
+CostModelPendulumTpl<Scalar, NJoints>::CostModelPendulumTpl(const boost::shared_ptr<StateMultibody> &state,
+                                                 const boost::shared_ptr<ActivationModelAbstract> &activation,
+                                                 const size_t &nu) : Base(state, activation, nu)
 {
-    this->reference_theta    = 0;
-    this->reference_alpha    = 0;
-    this->referece_dot_theta = 0;
-    this->referece_dot_alpha = 0;
+    assert(activation->get_nr() == 3 * NJoints && "The activation needs 3 * NJoints residuals");
+
+    this->reference_q.setZero();
+    this->reference_v.setZero();
+}
+
+template<typename Scalar, int NJoints>
+void CostModelPendulumTpl<Scalar, NJoints>::setReference(const Eigen::Ref<const VectorXs> &x_ref){
+    this->reference_q = x_ref.template head<NJoints>();
+    this->reference_v = x_ref.template tail<NJoints>();
 }
 
-void CostModelDoublePendulum::setReference(double new_theta, double new_alpha, double new_dot_theta, double new_dot_alpha){
-    this->reference_theta    = new_theta;
-    this->reference_alpha    = new_alpha;
-    this->referece_dot_theta = new_dot_theta;
-    this->referece_dot_alpha = new_dot_alpha;
+template<typename Scalar, int NJoints>
+void CostModelPendulumTpl<Scalar, NJoints>::getReference(Eigen::Ref<VectorXs> x_ref) const{
+    x_ref.template head<NJoints>() = this->reference_q;
+    x_ref.template tail<NJoints>() = this->reference_v;
 }
 
-void CostModelDoublePendulum::calc(const boost::shared_ptr<crocoddyl::CostDataAbstract> &data,
+template<typename Scalar, int NJoints>
+void CostModelPendulumTpl<Scalar, NJoints>::calc(const boost::shared_ptr<CostDataAbstract> &data,
                                    const Eigen::Ref<const VectorXs> &x,
                                    const Eigen::Ref<const VectorXs> &u) {
-    double c1 = cos(x[0] - reference_theta);
-    double c2 = cos(x[1] - reference_alpha);
-    
-    double s1 = sin(x[0] - reference_theta);
-    double s2 = sin(x[1] - reference_alpha);
+    const VectorNs e = x.template head<NJoints>() - reference_q;
     
-    data->r << s1, s2, 1 - c1, 1 - c2, x[2] - referece_dot_theta, x[3] - referece_dot_alpha;
+    data->r.template head<NJoints>() = e.array().sin().matrix();
+    data->r.template segment<NJoints>(NJoints) = (Scalar(1) - e.array().cos()).matrix();
+    data->r.template tail<NJoints>() = x.template tail<NJoints>() - reference_v;
     
-    activation_->calc(data->activation,data->r);    
+    this->activation_->calc(data->activation,data->r);    
     data->cost = data->activation->a_value;
 }
 
-void CostModelDoublePendulum::calcDiff(const boost::shared_ptr<crocoddyl::CostDataAbstract> &data,
+template<typename Scalar, int NJoints>
+void CostModelPendulumTpl<Scalar, NJoints>::calcDiff(const boost::shared_ptr<CostDataAbstract> &data,
                                        const Eigen::Ref<const VectorXs> &x,
                                        const Eigen::Ref<const VectorXs> &u) {
     
-    double c1 = cos(x[0] - reference_theta);
-    double c2 = cos(x[1] - reference_alpha);
+    const VectorNs e = x.template head<NJoints>() - reference_q;
+    const VectorNs c = e.array().cos().matrix();
+    const VectorNs s = e.array().sin().matrix();
     
-    double s1 = sin(x[0] - reference_theta);
-    double s2 = sin(x[1] - reference_alpha);
-    
-    activation_->calcDiff(data->activation,data->r);
+    this->activation_->calcDiff(data->activation,data->r);
 
-    //Jacobià
-    Eigen::MatrixXd J = Eigen::MatrixXd::Zero(6,4);
-    J << c1,0 ,0,0,
-         0 ,c2,0,0,
-         s1,0 ,0,0,
-         0 ,s2,0,0,
-         0 ,0 ,1,0,
-         0 ,0 ,0,1;
-    J.transposeInPlace();
-    data->Lx = J * data->activation->Ar;
-    
+    const auto &Ar = data->activation->Ar;
+    const auto Arr = data->activation->Arr.diagonal();
 
-    //Matriu Hessiana
-    Eigen::MatrixXd H = Eigen::MatrixXd::Zero(6,4);
-    H << pow(c1,2) - pow(s1,2)     ,0                         ,0, 0,
-         0                         ,pow(c2,2) - pow(s2,2)     ,0, 0,
-         pow(s1,2) + (1 - c1) * c1 ,0                         ,0, 0,
-         0                         ,pow(s2,2) + (1 - c2) * c2 ,0, 0,
-         0                         ,0                         ,1, 0,
-         0                         ,0                         ,0, 1;
-    H.transposeInPlace();
+    //Jacobià: the residual only depends on each joint through its own angle or velocity.
+    data->Lx.template head<NJoints>() = c.cwiseProduct(Ar.template head<NJoints>()) + s.cwiseProduct(Ar.template segment<NJoints>(NJoints));
+    data->Lx.template tail<NJoints>() = Ar.template tail<NJoints>();
 
-    MatrixXs A = H * data->activation->Arr.diagonal();
-    data->Lxx = A.asDiagonal();
+    //Matriu Hessiana (diagonal)
+    data->Lxx.diagonal().template head<NJoints>() =
+        (c.array().square() - s.array().square()) * Arr.template head<NJoints>().array()
+        + (s.array().square() + (Scalar(1) - c.array()) * c.array()) * Arr.template segment<NJoints>(NJoints).array();
+    data->Lxx.diagonal().template tail<NJoints>() = Arr.template tail<NJoints>();
 }
+
+template class CostModelPendulumTpl<double, 2>;
+template class CostModelPendulumTpl<double, 3>;
+template class CostModelPendulumTpl<double, 4>;
+template class CostModelPendulumTpl<double, 5>;
+
+template class CostModelPendulumTpl<float, 2>;
+template class CostModelPendulumTpl<float, 3>;
+template class CostModelPendulumTpl<float, 4>;
+template class CostModelPendulumTpl<float, 5>;
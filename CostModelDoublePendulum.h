@@ -26,17 +26,29 @@
 
 #include "yaml_parser/parser_yaml.h"
 
-class CostModelDoublePendulum: public crocoddyl::CostModelAbstract 
+// Goal cost of a planar chain of NJoints revolute joints. The residual is
+//   [ sin(q - q_ref) | 1 - cos(q - q_ref) | v - v_ref ]
+// so it has 3 * NJoints entries and is periodic in the joint angles.
+template<typename _Scalar, int NJoints>
+class CostModelPendulumTpl: public crocoddyl::CostModelAbstractTpl<_Scalar>
 {
+public:
+    typedef _Scalar Scalar;
+    typedef crocoddyl::CostModelAbstractTpl<Scalar> Base;
+    typedef crocoddyl::MathBaseTpl<Scalar> MathBase;
+    typedef crocoddyl::StateMultibodyTpl<Scalar> StateMultibody;
+    typedef crocoddyl::ActivationModelAbstractTpl<Scalar> ActivationModelAbstract;
+    typedef crocoddyl::CostDataAbstractTpl<Scalar> CostDataAbstract;
+    typedef typename MathBase::VectorXs VectorXs;
+    typedef Eigen::Matrix<Scalar, NJoints, 1> VectorNs;
+
 private:
-    double reference_theta;
-    double reference_alpha;
-    double referece_dot_theta;
-    double referece_dot_alpha;
+    Eigen::Matrix<Scalar, NJoints, 1, Eigen::DontAlign> reference_q;
+    Eigen::Matrix<Scalar, NJoints, 1, Eigen::DontAlign> reference_v;
 
 public:
 
-    CostModelDoublePendulum(const boost::shared_ptr<StateMultibody> &state,
+    CostModelPendulumTpl(const boost::shared_ptr<StateMultibody> &state,
                             const boost::shared_ptr<ActivationModelAbstract> &activation, const size_t &nu);
 
     void calc(const boost::shared_ptr <CostDataAbstract> &data, const Eigen::Ref<const VectorXs> &x,
@@ -45,8 +57,33 @@ public:
     void calcDiff(const boost::shared_ptr<CostDataAbstract> &data, const Eigen::Ref<const VectorXs> &x,
                   const Eigen::Ref<const VectorXs> &u) override;
 
-    void setReference(double new_theta, double reference_alpha, double new_dot_theta, double new_dot_alpha);
+    // x_ref holds the reference angles followed by the reference velocities.
+    void setReference(const Eigen::Ref<const VectorXs> &x_ref);
+    void getReference(Eigen::Ref<VectorXs> x_ref) const;
 };
 
+typedef CostModelPendulumTpl<double, 2> CostModelDoublePendulum;
+
+//set_weights only reaches the Hessian of the first node data that calcDiff runs on after it, the
+//rest keep the old Arr. Writes the weights into the x_goal activation data of a node.
+template<typename Scalar>
+void setGoalActivationData(const boost::shared_ptr<crocoddyl::ActionDataAbstractTpl<Scalar>>& data,
+                           const typename crocoddyl::MathBaseTpl<Scalar>::VectorXs& weights)
+{
+    auto differential = boost::static_pointer_cast<crocoddyl::DifferentialActionDataFreeFwdDynamicsTpl<Scalar>>(
+        boost::static_pointer_cast<crocoddyl::IntegratedActionDataEulerTpl<Scalar>>(data)->differential);
+    auto item = differential->costs->costs.find("x_goal");
+    if(item != differential->costs->costs.end()) item->second->activation->Arr.diagonal() = weights;
+}
+
+//Same for every node data of a problem.
+template<typename Scalar>
+void setGoalActivationData(const boost::shared_ptr<crocoddyl::ShootingProblemTpl<Scalar>>& problem,
+                           const typename crocoddyl::MathBaseTpl<Scalar>::VectorXs& weights)
+{
+    for(auto const& data: problem->get_runningDatas()) setGoalActivationData<Scalar>(data, weights);
+    setGoalActivationData<Scalar>(problem->get_terminalData(), weights);
+}
+
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,254 @@
+#include "DataAcquisition.h"
+
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <time.h>
+
+StreamingPeakDetector::StreamingPeakDetector(double hysteresis, std::size_t capacity) :
+    hysteresis(hysteresis), direction(0), t_first(0), t_last(0), value_last(0), count(0)
+{
+    extrema.reserve(capacity);
+}
+
+//sign = +1 keeps the highest sample, -1 the lowest, with the samples around it for the refinement.
+void StreamingPeakDetector::track(Candidate &candidate, double sign, double t, double value)
+{
+    if(sign * value > sign * candidate.value){
+        candidate = {t, value, t_last, value_last, t, value, false};
+    }else if(!candidate.has_next && candidate.t == t_last){
+        candidate.t_next = t;
+        candidate.value_next = value;
+        candidate.has_next = true;
+    }
+}
+
+void StreamingPeakDetector::emit(const Candidate &candidate, bool maximum)
+{
+    Extremum extremum = {candidate.t, candidate.value, maximum};
+
+    //Vertex of the parabola through the three samples, they do not need to be evenly spaced.
+    const double d0 = candidate.t - candidate.t_prev, d2 = candidate.t - candidate.t_next;
+    const double e0 = candidate.value - candidate.value_prev, e2 = candidate.value - candidate.value_next;
+    const double denominator = d0 * e2 - d2 * e0;
+    if(candidate.has_next && d0 > 0 && std::abs(denominator) > 1e-15){
+        const double t = candidate.t - 0.5 * (d0 * d0 * e2 - d2 * d2 * e0) / denominator;
+        if(t > candidate.t_prev && t < candidate.t_next){
+            //Value of the parabola at its vertex from the Lagrange form.
+            const double curvature = (e2 / d2 - e0 / d0) / (d0 - d2);
+            extremum.value = candidate.value - curvature * (t - candidate.t) * (t - candidate.t);
+            extremum.t = t;
+        }
+    }
+
+    if(extrema.size() < extrema.capacity())
+        extrema.push_back(extremum);
+}
+
+void StreamingPeakDetector::update(double t, double value)
+{
+    if(count++ == 0){
+        max_candidate = min_candidate = {t, value, t, value, t, value, false};
+        t_first = t;
+        t_last = t;
+        value_last = value;
+        return;
+    }
+
+    if(direction >= 0) track(max_candidate, 1, t, value);
+    if(direction <= 0) track(min_candidate, -1, t, value);
+
+    if(direction >= 0 && value < max_candidate.value - hysteresis){
+        emit(max_candidate, true);
+        direction = -1;
+        min_candidate = {t, value, t_last, value_last, t, value, false};
+    }else if(direction <= 0 && value > min_candidate.value + hysteresis){
+        emit(min_candidate, false);
+        direction = 1;
+        max_candidate = {t, value, t_last, value_last, t, value, false};
+    }
+
+    t_last = t;
+    value_last = value;
+}
+
+const std::vector<StreamingPeakDetector::Extremum>& StreamingPeakDetector::get_extrema() const
+{
+    return extrema;
+}
+
+double StreamingPeakDetector::get_period() const
+{
+    double sum = 0;
+    int intervals = 0;
+    for(int kind = 0; kind < 2; kind++){
+        double t_previous = -1;
+        for(auto const& extremum: extrema){
+            //An extremum on the first sample may only be where the recording started.
+            if(extremum.maximum != (kind == 0) || extremum.t == t_first) continue;
+            if(t_previous >= 0){
+                sum += extremum.t - t_previous;
+                intervals++;
+            }
+            t_previous = extremum.t;
+        }
+    }
+    return intervals ? sum / intervals : -1;
+}
+
+static double monotonicSeconds()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static timespec toTimespec(double seconds)
+{
+    timespec time;
+    time.tv_sec = (time_t)seconds;
+    time.tv_nsec = (long)((seconds - time.tv_sec) * 1e9);
+    if(time.tv_nsec >= 1000000000L){
+        time.tv_sec++;
+        time.tv_nsec -= 1000000000L;
+    }
+    return time;
+}
+
+DataAcquisition::DataAcquisition(const std::vector<std::string> &channels, double period, long capacity) :
+    channels(channels), period(period), capacity(capacity), samples(0), peak_channel(-1),
+    lateness_sum(0), lateness_square_sum(0), lateness_max(0), read_time_max(0), missed_deadlines(0)
+{
+    values.resize(capacity * channels.size());
+    times.resize(capacity);
+}
+
+void DataAcquisition::detectPeaks(int channel, double hysteresis)
+{
+    peak_channel = channel;
+    //Two extrema per oscillation, far fewer than one per sample in practice.
+    peak_detector = boost::make_shared<StreamingPeakDetector>(hysteresis, capacity / 2 + 1);
+}
+
+long DataAcquisition::run(double duration, const std::function<void(double *values)> &read,
+                          const std::function<void(double t, const double *values)> &on_sample)
+{
+    const std::size_t n_channels = channels.size();
+    const long target = std::min(capacity, (long)(duration / period));
+
+    const double start = monotonicSeconds();
+    double deadline = start;
+    long report = std::max(target / 10, 1L);
+
+    while(samples < target)
+    {
+        const timespec wake = toTimespec(deadline);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, nullptr);
+
+        const double before = monotonicSeconds();
+        double *row = values.data() + samples * n_channels;
+        read(row);
+        const double after = monotonicSeconds();
+
+        //The read is stamped at its midpoint, the drivers give no time of their own.
+        const double t = 0.5 * (before + after) - start;
+        times[samples] = t;
+
+        const double lateness = before - deadline;
+        lateness_sum += lateness;
+        lateness_square_sum += lateness * lateness;
+        lateness_max = std::max(lateness_max, lateness);
+        read_time_max = std::max(read_time_max, after - before);
+
+        if(peak_detector) peak_detector->update(t, row[peak_channel]);
+        if(on_sample) on_sample(t, row);
+
+        samples++;
+        if(samples % report == 0)
+            std::cout << "Sample: " << samples << std::endl;
+
+        //Stay on the grid, the slots that already went by are skipped and counted.
+        deadline += period;
+        const double now = monotonicSeconds();
+        if(now > deadline + period){
+            const long missed = (long)((now - deadline) / period);
+            missed_deadlines += missed;
+            deadline += missed * period;
+        }
+    }
+    return samples;
+}
+
+long DataAcquisition::size() const
+{
+    return samples;
+}
+
+double DataAcquisition::time(long sample) const
+{
+    return times[sample];
+}
+
+double DataAcquisition::value(long sample, int channel) const
+{
+    return values[sample * channels.size() + channel];
+}
+
+int DataAcquisition::channel(const std::string &name) const
+{
+    auto it = std::find(channels.begin(), channels.end(), name);
+    return it == channels.end() ? -1 : (int)(it - channels.begin());
+}
+
+const StreamingPeakDetector* DataAcquisition::get_peak_detector() const
+{
+    return peak_detector.get();
+}
+
+void DataAcquisition::resample(int channel, double resample_period, std::vector<double> &out) const
+{
+    out.clear();
+    if(samples == 0) return;
+
+    const double t0 = times[0];
+    const long n = (long)((times[samples - 1] - t0) / resample_period) + 1;
+    out.reserve(n);
+
+    long j = 0;
+    for(long i = 0; i < n; i++){
+        const double t = t0 + i * resample_period;
+        while(j + 1 < samples && times[j + 1] < t) j++;
+        if(j + 1 >= samples){
+            out.push_back(value(samples - 1, channel));
+            continue;
+        }
+        const double span = times[j + 1] - times[j];
+        const double alpha = span > 0 ? (t - times[j]) / span : 0;
+        out.push_back((1 - alpha) * value(j, channel) + alpha * value(j + 1, channel));
+    }
+}
+
+void DataAcquisition::printJitter() const
+{
+    if(samples == 0) return;
+
+    const double mean = lateness_sum / samples;
+    const double deviation = std::sqrt(std::max(lateness_square_sum / samples - mean * mean, 0.0));
+
+    //Spacing of the timestamps against the nominal period.
+    double interval_max_error = 0;
+    double interval_square_sum = 0;
+    for(long i = 1; i < samples; i++){
+        const double error = times[i] - times[i - 1] - period;
+        interval_max_error = std::max(interval_max_error, std::abs(error));
+        interval_square_sum += error * error;
+    }
+    const double interval_rms = samples > 1 ? std::sqrt(interval_square_sum / (samples - 1)) : 0;
+
+    std::cout << "Acquisition: " << samples << " samples of " << channels.size() << " channels every " << period * 1e3 << " ms." << std::endl;
+    std::cout << "  Wake up lateness mean " << mean * 1e6 << " us, std " << deviation * 1e6 << " us, max " << lateness_max * 1e6 << " us." << std::endl;
+    std::cout << "  Sample interval error rms " << interval_rms * 1e6 << " us, max " << interval_max_error * 1e6 << " us." << std::endl;
+    std::cout << "  Longest read " << read_time_max * 1e6 << " us, " << missed_deadlines << " missed deadlines." << std::endl;
+}
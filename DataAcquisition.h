@@ -0,0 +1,106 @@
+#ifndef DoublePENDULUM_DATAACQUISITION_H
+#define DoublePENDULUM_DATAACQUISITION_H
+
+#include <boost/shared_ptr.hpp>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Finds the maxima and minima of a signal one sample at a time. An extremum is confirmed once
+// the signal moves back from it by more than the hysteresis, and its time is refined with the
+// parabola through it and its two neighbours, so it is not tied to the sampling grid.
+class StreamingPeakDetector
+{
+public:
+    struct Extremum
+    {
+        double t;
+        double value;
+        bool maximum;
+    };
+
+private:
+    struct Candidate
+    {
+        double t, value;
+        double t_prev, value_prev;
+        double t_next, value_next;
+        bool has_next;
+    };
+
+    double hysteresis;
+    // +1 looking for a maximum, -1 for a minimum, 0 before the first one.
+    int direction;
+    Candidate max_candidate;
+    Candidate min_candidate;
+    double t_first;
+    double t_last;
+    double value_last;
+    long count;
+
+    std::vector<Extremum> extrema;
+
+    void track(Candidate &candidate, double sign, double t, double value);
+    void emit(const Candidate &candidate, bool maximum);
+
+public:
+    StreamingPeakDetector(double hysteresis, std::size_t capacity);
+
+    void update(double t, double value);
+
+    const std::vector<Extremum>& get_extrema() const;
+    // Mean time between consecutive maxima and between consecutive minima, -1 without two of a kind.
+    double get_period() const;
+};
+
+// Samples a set of channels on an absolute time grid. Every period starts at a deadline of
+// CLOCK_MONOTONIC slept to with TIMER_ABSTIME, so the sampling does not drift with the read
+// time, and each sample is stored with the time it was actually read at in a buffer sized up
+// front. A missed deadline skips to the next one of the grid instead of sampling late twice.
+class DataAcquisition
+{
+private:
+    std::vector<std::string> channels;
+    double period;
+    long capacity;
+
+    // Row per sample, one column per channel.
+    std::vector<double> values;
+    std::vector<double> times;
+    long samples;
+
+    boost::shared_ptr<StreamingPeakDetector> peak_detector;
+    int peak_channel;
+
+    // Jitter
+    double lateness_sum;
+    double lateness_square_sum;
+    double lateness_max;
+    double read_time_max;
+    long missed_deadlines;
+
+public:
+    DataAcquisition(const std::vector<std::string> &channels, double period, long capacity);
+
+    // Runs the peak detector on a channel while sampling.
+    void detectPeaks(int channel, double hysteresis);
+
+    // read fills one value per channel. on_sample, when given, runs after each sample with its
+    // time from the start and has to fit in the period along with the read.
+    long run(double duration, const std::function<void(double *values)> &read,
+             const std::function<void(double t, const double *values)> &on_sample = nullptr);
+
+    long size() const;
+    double time(long sample) const;
+    double value(long sample, int channel) const;
+    int channel(const std::string &name) const;
+    const StreamingPeakDetector* get_peak_detector() const;
+
+    // Linear interpolation of a channel on a uniform grid from the first sample.
+    void resample(int channel, double resample_period, std::vector<double> &out) const;
+
+    void printJitter() const;
+};
+
+#endif
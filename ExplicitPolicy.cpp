@@ -0,0 +1,177 @@
+#include "ExplicitPolicy.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+static const char POLICY_MAGIC[4] = {'D', 'P', 'P', 'L'};
+
+ExplicitPolicy::ExplicitPolicy(int nx, int nu, int nq) : nx(nx), nu(nu), nq(nq), xs(nx, 0), us(nu, 0),
+    scale(Eigen::VectorXd::Ones(nx)), confidence_radius(std::numeric_limits<double>::infinity()), query(nx), dx(nx)
+{
+}
+
+void ExplicitPolicy::addSample(const Eigen::VectorXd &x, const Eigen::VectorXd &u, const Eigen::MatrixXd &K)
+{
+    int n = xs.cols();
+    xs.conservativeResize(Eigen::NoChange, n + 1);
+    us.conservativeResize(Eigen::NoChange, n + 1);
+
+    xs.col(n) = x;
+    for(int i = 0; i < nq; i++)
+        xs(i, n) = std::remainder(x[i], 2 * M_PI);
+    us.col(n) = u;
+    Ks.push_back(K);
+}
+
+void ExplicitPolicy::setMetric(const Eigen::VectorXd &scale, double confidence_radius)
+{
+    this->scale = scale;
+    this->confidence_radius = confidence_radius;
+}
+
+int ExplicitPolicy::size() const
+{
+    return xs.cols();
+}
+
+void ExplicitPolicy::build()
+{
+    tree.resize(xs.cols());
+    for(int i = 0; i < (int)tree.size(); i++) tree[i] = i;
+
+    buildTree(0, tree.size(), 0);
+    std::cout << "Policy k-d tree built with " << tree.size() << " samples." << std::endl;
+}
+
+void ExplicitPolicy::buildTree(int begin, int end, int depth)
+{
+    if(end - begin <= 1) return;
+
+    int dim = depth % nx;
+    int mid = (begin + end) / 2;
+    std::nth_element(tree.begin() + begin, tree.begin() + mid, tree.begin() + end,
+                     [&](int a, int b){ return xs(dim, a) < xs(dim, b); });
+
+    buildTree(begin, mid, depth + 1);
+    buildTree(mid + 1, end, depth + 1);
+}
+
+//Angles are compared the short way around, the hanging state sits right on the ±pi seam.
+double ExplicitPolicy::scaledDistance(int sample) const
+{
+    double distance = 0;
+    for(int i = 0; i < nx; i++){
+        double d = query[i] - xs(i, sample);
+        if(i < nq) d = std::remainder(d, 2 * M_PI);
+        d *= scale[i];
+        distance += d * d;
+    }
+    return distance;
+}
+
+void ExplicitPolicy::searchTree(int begin, int end, int depth, int &best, double &best_distance) const
+{
+    if(begin >= end) return;
+
+    int dim = depth % nx;
+    int mid = (begin + end) / 2;
+    int sample = tree[mid];
+
+    double distance = scaledDistance(sample);
+    if(distance < best_distance){
+        best_distance = distance;
+        best = sample;
+    }
+
+    double split = query[dim] - xs(dim, sample);
+    bool left_first = split < 0;
+
+    if(left_first) searchTree(begin, mid, depth + 1, best, best_distance);
+    else           searchTree(mid + 1, end, depth + 1, best, best_distance);
+
+    //Only visit the other side if the splitting plane is closer than the best sample. An angle
+    //also reaches the other side across the seam, past -pi to the right one or past pi to the left.
+    double gap = std::abs(split);
+    if(dim < nq) gap = std::min(gap, left_first ? query[dim] + M_PI : M_PI - query[dim]);
+    gap *= scale[dim];
+    if(gap * gap < best_distance){
+        if(left_first) searchTree(mid + 1, end, depth + 1, best, best_distance);
+        else           searchTree(begin, mid, depth + 1, best, best_distance);
+    }
+}
+
+bool ExplicitPolicy::computeControl(const Eigen::VectorXd &x, Eigen::VectorXd &u)
+{
+    if(tree.empty()) return false;
+
+    query = x;
+    for(int i = 0; i < nq; i++)
+        query[i] = std::remainder(x[i], 2 * M_PI);
+
+    int best = -1;
+    double best_distance = std::numeric_limits<double>::infinity();
+    searchTree(0, tree.size(), 0, best, best_distance);
+
+    if(std::sqrt(best_distance) > confidence_radius) return false;
+
+    dx = query - xs.col(best);
+    for(int i = 0; i < nq; i++)
+        dx[i] = std::remainder(dx[i], 2 * M_PI);
+    u = us.col(best);
+    u.noalias() -= Ks[best] * dx;
+    return true;
+}
+
+bool ExplicitPolicy::save(const std::string &path) const
+{
+    std::ofstream file(path, std::ios::binary);
+    if(!file) return false;
+
+    int n = xs.cols();
+    file.write(POLICY_MAGIC, sizeof(POLICY_MAGIC));
+    file.write(reinterpret_cast<const char*>(&nx), sizeof(nx));
+    file.write(reinterpret_cast<const char*>(&nu), sizeof(nu));
+    file.write(reinterpret_cast<const char*>(&n), sizeof(n));
+    file.write(reinterpret_cast<const char*>(xs.data()), sizeof(double) * xs.size());
+    file.write(reinterpret_cast<const char*>(us.data()), sizeof(double) * us.size());
+    for(auto const& K: Ks)
+        file.write(reinterpret_cast<const char*>(K.data()), sizeof(double) * K.size());
+
+    std::cout << "Policy saved with " << n << " samples to " << path << std::endl;
+    return file.good();
+}
+
+bool ExplicitPolicy::load(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if(!file) return false;
+
+    char magic[4];
+    int file_nx, file_nu, n;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&file_nx), sizeof(file_nx));
+    file.read(reinterpret_cast<char*>(&file_nu), sizeof(file_nu));
+    file.read(reinterpret_cast<char*>(&n), sizeof(n));
+
+    if(!file || !std::equal(magic, magic + 4, POLICY_MAGIC) || file_nx != nx || file_nu != nu){
+        std::cout << "Policy file " << path << " does not match the model." << std::endl;
+        return false;
+    }
+
+    xs.resize(nx, n);
+    us.resize(nu, n);
+    Ks.assign(n, Eigen::MatrixXd(nu, nx));
+
+    file.read(reinterpret_cast<char*>(xs.data()), sizeof(double) * xs.size());
+    file.read(reinterpret_cast<char*>(us.data()), sizeof(double) * us.size());
+    for(auto &K: Ks)
+        file.read(reinterpret_cast<char*>(K.data()), sizeof(double) * K.size());
+
+    if(!file) return false;
+
+    build();
+    return true;
+}
@@ -0,0 +1,53 @@
+#ifndef DoublePENDULUM_EXPLICITPOLICY_H
+#define DoublePENDULUM_EXPLICITPOLICY_H
+
+#include <Eigen/Dense>
+
+#include <string>
+#include <vector>
+
+// Gain table built offline from MPC solves. Each sample keeps the state it was solved
+// from, the first control and the first feedback gain, so a query near a sample gives
+// u = u_s - K_s (x - x_s). Samples are indexed with a k-d tree over the scaled state.
+class ExplicitPolicy
+{
+private:
+    int nx;
+    int nu;
+    int nq;
+
+    Eigen::MatrixXd xs;                 // nx x N, angles wrapped to [-pi, pi]
+    Eigen::MatrixXd us;                 // nu x N
+    std::vector<Eigen::MatrixXd> Ks;    // nu x nx each
+
+    // k-d tree stored implicitly: the median of every range is its node.
+    std::vector<int> tree;
+
+    Eigen::VectorXd scale;
+    double confidence_radius;
+
+    Eigen::VectorXd query;
+    Eigen::VectorXd dx;
+
+    void buildTree(int begin, int end, int depth);
+    void searchTree(int begin, int end, int depth, int &best, double &best_distance) const;
+    double scaledDistance(int sample) const;
+
+public:
+    ExplicitPolicy(int nx, int nu, int nq);
+
+    void addSample(const Eigen::VectorXd &x, const Eigen::VectorXd &u, const Eigen::MatrixXd &K);
+    void build();
+
+    void setMetric(const Eigen::VectorXd &scale, double confidence_radius);
+
+    // Returns false when the nearest sample is further than the confidence radius.
+    bool computeControl(const Eigen::VectorXd &x, Eigen::VectorXd &u);
+
+    bool save(const std::string &path) const;
+    bool load(const std::string &path);
+
+    int size() const;
+};
+
+#endif
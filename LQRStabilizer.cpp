@@ -0,0 +1,108 @@
+#include "LQRStabilizer.h"
+
+#include "pinocchio/algorithm/rnea.hpp"
+
+#include <iostream>
+
+LQRStabilizer::LQRStabilizer(const boost::shared_ptr<crocoddyl::StateMultibody> &state,
+                             const boost::shared_ptr<crocoddyl::ActuationModelAbstract> &actuation, double dt,
+                             const Eigen::VectorXd &x_eq, const Eigen::VectorXd &Q_diag, const Eigen::VectorXd &R_diag,
+                             double roa_enter, double roa_exit, const Eigen::VectorXd &u_lb, const Eigen::VectorXd &u_ub) :
+    x_eq(x_eq), u_lb(u_lb), u_ub(u_ub), roa_enter(roa_enter), roa_exit(roa_exit), engaged(false),
+    dx(state->get_ndx()), P_dx(state->get_ndx()), nq(state->get_nq())
+{
+    //Torque that holds the equilibrium: gravity mapped through the actuation.
+    pinocchio::Model &model = *state->get_pinocchio();
+    pinocchio::Data pinocchio_data(model);
+    Eigen::VectorXd gravity = pinocchio::computeGeneralizedGravity(model, pinocchio_data, x_eq.head(nq));
+
+    auto actuation_data = actuation->createData();
+    actuation->calcDiff(actuation_data, x_eq, Eigen::VectorXd::Zero(actuation->get_nu()));
+    u_eq = actuation_data->dtau_du.colPivHouseholderQr().solve(gravity);
+
+    //Linearize with the same discretization as the MPC, without costs.
+    auto costs = boost::make_shared<crocoddyl::CostModelSum>(state, actuation->get_nu());
+    auto diff_model = boost::make_shared<crocoddyl::DifferentialActionModelFreeFwdDynamics>(state, actuation, costs);
+    auto int_model = boost::make_shared<crocoddyl::IntegratedActionModelEuler>(diff_model, dt);
+    auto int_data = int_model->createData();
+
+    int_model->calc(int_data, x_eq, u_eq);
+    int_model->calcDiff(int_data, x_eq, u_eq);
+    A = int_data->Fx;
+    B = int_data->Fu;
+
+    solveRiccati(Q_diag.asDiagonal(), R_diag.asDiagonal());
+
+    std::cout << "LQR gain at the upright equilibrium:" << std::endl << K << std::endl;
+}
+
+void LQRStabilizer::solveRiccati(const Eigen::MatrixXd &Q, const Eigen::MatrixXd &R)
+{
+    P = Q;
+    for(int i = 0; i < 100000; i++)
+    {
+        K = (R + B.transpose() * P * B).ldlt().solve(B.transpose() * P * A);
+        Eigen::MatrixXd P_next = Q + A.transpose() * P * (A - B * K);
+
+        double change = (P_next - P).lpNorm<Eigen::Infinity>();
+        P = P_next;
+
+        if(change < 1e-10){
+            std::cout << "Riccati converged in " << i << " iterations." << std::endl;
+            return;
+        }
+    }
+    std::cout << "Riccati did not converge, the LQR gain may be wrong." << std::endl;
+}
+
+void LQRStabilizer::computeStateError(const Eigen::VectorXd &x)
+{
+    dx = x - x_eq;
+    for(int i = 0; i < nq; i++)
+        dx[i] = std::remainder(dx[i], 2 * M_PI);
+}
+
+double LQRStabilizer::costToGo(const Eigen::VectorXd &x)
+{
+    computeStateError(x);
+    P_dx.noalias() = P * dx;
+    return dx.dot(P_dx);
+}
+
+bool LQRStabilizer::update(const Eigen::VectorXd &x)
+{
+    double V = costToGo(x);
+
+    if(engaged && V > roa_exit){
+        engaged = false;
+        std::cout << "Leaving the LQR region. V = " << V << std::endl;
+    }else if(!engaged && V < roa_enter){
+        engaged = true;
+        std::cout << "Entering the LQR region. V = " << V << std::endl;
+    }
+    return engaged;
+}
+
+void LQRStabilizer::computeControl(const Eigen::VectorXd &x, Eigen::VectorXd &u)
+{
+    computeStateError(x);
+    u = u_eq;
+    u.noalias() -= K * dx;
+    u = u.cwiseMax(u_lb).cwiseMin(u_ub);
+}
+
+void LQRStabilizer::set_bounds(const Eigen::VectorXd &u_lb, const Eigen::VectorXd &u_ub)
+{
+    this->u_lb = u_lb;
+    this->u_ub = u_ub;
+}
+
+bool LQRStabilizer::isEngaged() const
+{
+    return engaged;
+}
+
+const Eigen::MatrixXd& LQRStabilizer::get_K() const
+{
+    return K;
+}
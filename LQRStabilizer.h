@@ -0,0 +1,58 @@
+#ifndef DoublePENDULUM_LQRSTABILIZER_H
+#define DoublePENDULUM_LQRSTABILIZER_H
+
+#include "crocoddyl/core/fwd.hpp"
+#include "crocoddyl/core/integrator/euler.hpp"
+#include "crocoddyl/multibody/fwd.hpp"
+#include "crocoddyl/multibody/costs/cost-sum.hpp"
+#include "crocoddyl/multibody/actions/free-fwddyn.hpp"
+
+// Infinite horizon LQR around the upright equilibrium. The gain is computed once,
+// using the same Euler discretization as the MPC nodes, so evaluating the law is
+// just a matrix-vector product.
+class LQRStabilizer
+{
+private:
+    Eigen::VectorXd x_eq;
+    Eigen::VectorXd u_eq;
+
+    Eigen::MatrixXd A;
+    Eigen::MatrixXd B;
+    Eigen::MatrixXd K;
+    Eigen::MatrixXd P;
+
+    Eigen::VectorXd u_lb;
+    Eigen::VectorXd u_ub;
+
+    // Region of attraction in terms of the LQR cost to go dx' P dx.
+    double roa_enter;
+    double roa_exit;
+    bool engaged;
+
+    Eigen::VectorXd dx;
+    Eigen::VectorXd P_dx;
+    int nq;
+
+    void computeStateError(const Eigen::VectorXd &x);
+    void solveRiccati(const Eigen::MatrixXd &Q, const Eigen::MatrixXd &R);
+
+public:
+    LQRStabilizer(const boost::shared_ptr<crocoddyl::StateMultibody> &state,
+                  const boost::shared_ptr<crocoddyl::ActuationModelAbstract> &actuation, double dt,
+                  const Eigen::VectorXd &x_eq, const Eigen::VectorXd &Q_diag, const Eigen::VectorXd &R_diag,
+                  double roa_enter, double roa_exit, const Eigen::VectorXd &u_lb, const Eigen::VectorXd &u_ub);
+
+    // Updates the hysteresis with the measured state and tells if the LQR law should be used.
+    bool update(const Eigen::VectorXd &x);
+
+    void computeControl(const Eigen::VectorXd &x, Eigen::VectorXd &u);
+
+    void set_bounds(const Eigen::VectorXd &u_lb, const Eigen::VectorXd &u_ub);
+
+    double costToGo(const Eigen::VectorXd &x);
+    bool isEngaged() const;
+
+    const Eigen::MatrixXd& get_K() const;
+};
+
+#endif
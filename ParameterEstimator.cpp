@@ -0,0 +1,133 @@
+#include "ParameterEstimator.h"
+
+#include "pinocchio/algorithm/regressor.hpp"
+
+#include <iostream>
+
+ParameterEstimator::ParameterEstimator(const pinocchio::Model &model, const Eigen::VectorXd &torque_constants,
+                                       double friction_smoothing, double mass_prior_std, double parameter_prior_std,
+                                       double forgetting_factor, double acceleration_filter) :
+    model(model), data(model), nv(model.nv), n_links(model.njoints - 1), friction_smoothing(friction_smoothing),
+    forgetting_factor(forgetting_factor), acceleration_filter(acceleration_filter), last_t(0), has_last(false), sample_count(0)
+{
+    n_params = 10 * n_links + 3 * nv;
+
+    //Prior: the URDF and the nominal torque constants.
+    theta = Eigen::VectorXd(n_params);
+    for(int j = 0; j < n_links; j++)
+        theta.segment<10>(10 * j) = model.inertias[j + 1].toDynamicParameters();
+    theta.segment(10 * n_links, nv) = model.damping;
+    theta.segment(10 * n_links + nv, nv) = model.friction;
+    theta.tail(nv) = torque_constants;
+
+    //Relative prior standard deviations. Zero parameters get a small absolute one.
+    P = Eigen::MatrixXd::Zero(n_params, n_params);
+    for(int i = 0; i < n_params; i++){
+        double magnitude = std::max(std::abs(theta[i]), 1e-3);
+        P(i, i) = std::pow(parameter_prior_std * magnitude, 2);
+    }
+    for(int j = 0; j < n_links; j++)
+        P(10 * j, 10 * j) = std::pow(mass_prior_std * theta[10 * j], 2);
+
+    phi = Eigen::MatrixXd::Zero(nv, n_params);
+    gain = Eigen::MatrixXd::Zero(n_params, nv);
+    innovation_covariance = Eigen::MatrixXd::Zero(nv, nv);
+    residual = Eigen::VectorXd::Zero(nv);
+
+    last_v = Eigen::VectorXd::Zero(nv);
+    acceleration = Eigen::VectorXd::Zero(nv);
+}
+
+void ParameterEstimator::addSample(double t, const Eigen::VectorXd &q, const Eigen::VectorXd &v, const Eigen::VectorXd &current)
+{
+    double dt = t - last_t;
+
+    if(!has_last || dt <= 0){
+        has_last = true;
+        last_t = t;
+        last_v = v;
+        return;
+    }
+
+    //Low pass filtered finite difference of the velocity.
+    acceleration = acceleration_filter * (v - last_v) / dt + (1 - acceleration_filter) * acceleration;
+    last_t = t;
+    last_v = v;
+
+    pinocchio::computeJointTorqueRegressor(model, data, q, v, acceleration);
+
+    phi.leftCols(10 * n_links) = data.jointTorqueRegressor;
+    phi.block(0, 10 * n_links, nv, nv).diagonal() = v;
+    phi.block(0, 10 * n_links + nv, nv, nv).diagonal() = (v.array() / friction_smoothing).tanh().matrix();
+    phi.rightCols(nv).diagonal() = -current;
+
+    //The measurement is 0, so the innovation is just -phi * theta.
+    residual.noalias() = -phi * theta;
+
+    innovation_covariance.noalias() = phi * P * phi.transpose();
+    innovation_covariance.diagonal().array() += forgetting_factor;
+    gain.noalias() = P * phi.transpose() * innovation_covariance.inverse();
+
+    theta.noalias() += gain * residual;
+    P.noalias() -= gain * phi * P;
+    P = 0.5 * (P + P.transpose()) / forgetting_factor;
+
+    sample_count++;
+}
+
+bool ParameterEstimator::applyToModel(pinocchio::Model &model) const
+{
+    std::vector<pinocchio::Inertia> inertias;
+
+    for(int j = 0; j < n_links; j++)
+    {
+        pinocchio::Inertia inertia = pinocchio::Inertia::FromDynamicParameters(theta.segment<10>(10 * j));
+
+        Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eigen_solver(inertia.inertia().matrix());
+        if(inertia.mass() <= 0 || eigen_solver.eigenvalues().minCoeff() <= 0){
+            std::cout << "Identified inertia of link " << j + 1 << " is not physically consistent, keeping the model." << std::endl;
+            return false;
+        }
+        inertias.push_back(inertia);
+    }
+
+    for(int j = 0; j < n_links; j++)
+        model.inertias[j + 1] = inertias[j];
+
+    model.damping = get_viscous_friction();
+    model.friction = get_coulomb_friction();
+    return true;
+}
+
+Eigen::VectorXd ParameterEstimator::get_viscous_friction() const
+{
+    return theta.segment(10 * n_links, nv);
+}
+
+Eigen::VectorXd ParameterEstimator::get_coulomb_friction() const
+{
+    return theta.segment(10 * n_links + nv, nv);
+}
+
+Eigen::VectorXd ParameterEstimator::get_torque_constants() const
+{
+    return theta.tail(nv);
+}
+
+long ParameterEstimator::get_sample_count() const
+{
+    return sample_count;
+}
+
+void ParameterEstimator::print() const
+{
+    std::cout << "Identified parameters after " << sample_count << " samples:" << std::endl;
+    for(int j = 0; j < n_links; j++){
+        auto inertia = pinocchio::Inertia::FromDynamicParameters(theta.segment<10>(10 * j));
+        std::cout << "Link " << j + 1 << " mass: " << inertia.mass() << " com: " << inertia.lever().transpose() << std::endl
+        << "inertia: " << std::endl << inertia.inertia().matrix() << std::endl;
+    }
+    std::cout << "Viscous friction: " << get_viscous_friction().transpose() << std::endl
+    << "Coulomb friction: " << get_coulomb_friction().transpose() << std::endl
+    << "Torque constants: " << get_torque_constants().transpose() << std::endl;
+}
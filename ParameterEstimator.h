@@ -0,0 +1,61 @@
+#ifndef DoublePENDULUM_PARAMETERESTIMATOR_H
+#define DoublePENDULUM_PARAMETERESTIMATOR_H
+
+#include "pinocchio/multibody/model.hpp"
+#include "pinocchio/multibody/data.hpp"
+
+// Streaming recursive least squares on the joint torque regressor. The parameters are
+//   [ dynamic parameters of every link (10 each) | viscous friction | coulomb friction | torque constants ]
+// and every sample gives the rows  Y(q, v, a) pi + Fv v + Fc tanh(v / s) - diag(i) kt = 0.
+// That system only fixes the parameters up to a common scale, the tight prior on the link
+// masses (weighed on a scale, unlike the rest) is what anchors it.
+class ParameterEstimator
+{
+private:
+    pinocchio::Model model;
+    pinocchio::Data data;
+
+    int nv;
+    int n_links;
+    int n_params;
+    double friction_smoothing;
+    double forgetting_factor;
+    double acceleration_filter;
+
+    Eigen::VectorXd theta;
+    Eigen::MatrixXd P;
+
+    // Regression scratch
+    Eigen::MatrixXd phi;
+    Eigen::MatrixXd gain;
+    Eigen::MatrixXd innovation_covariance;
+    Eigen::VectorXd residual;
+
+    // Acceleration from filtered velocity differences
+    Eigen::VectorXd last_v;
+    Eigen::VectorXd acceleration;
+    double last_t;
+    bool has_last;
+
+    long sample_count;
+
+public:
+    ParameterEstimator(const pinocchio::Model &model, const Eigen::VectorXd &torque_constants, double friction_smoothing,
+                       double mass_prior_std, double parameter_prior_std, double forgetting_factor, double acceleration_filter);
+
+    // current holds the motor current of every joint, zero for the unactuated ones.
+    void addSample(double t, const Eigen::VectorXd &q, const Eigen::VectorXd &v, const Eigen::VectorXd &current);
+
+    // Writes the link inertias into model. Returns false and leaves it untouched if the
+    // estimate is not physically consistent yet.
+    bool applyToModel(pinocchio::Model &model) const;
+
+    Eigen::VectorXd get_viscous_friction() const;
+    Eigen::VectorXd get_coulomb_friction() const;
+    Eigen::VectorXd get_torque_constants() const;
+    long get_sample_count() const;
+
+    void print() const;
+};
+
+#endif
@@ -0,0 +1,114 @@
+#include "PendulumProblem.h"
+
+#include <limits>
+
+void pendulumStateLimits(const pinocchio::Model &model, double max_joint_velocity, Eigen::VectorXd &lb, Eigen::VectorXd &ub)
+{
+    const double unbounded = std::numeric_limits<double>::max();
+    lb = Eigen::VectorXd::Constant(2 * model.nv, -unbounded);
+    ub = Eigen::VectorXd::Constant(2 * model.nv, unbounded);
+
+    //The URDF writes lower = upper = 0 for joints without limits, those are left free.
+    for(int i = 0; i < model.nq; i++){
+        if(model.lowerPositionLimit[i] < model.upperPositionLimit[i]){
+            lb[i] = model.lowerPositionLimit[i];
+            ub[i] = model.upperPositionLimit[i];
+        }
+    }
+
+    for(int i = 0; i < model.nv; i++){
+        double v_max = model.velocityLimit[i] > 0 ? model.velocityLimit[i] : max_joint_velocity;
+        lb[model.nq + i] = -v_max;
+        ub[model.nq + i] = v_max;
+    }
+}
+
+template<typename Scalar, int NJoints>
+PendulumCostsTpl<Scalar, NJoints>::PendulumCostsTpl(const boost::shared_ptr<StateMultibody> &state, std::size_t nu,
+                                                    const PendulumCostWeights &weights,
+                                                    const Eigen::VectorXd &state_lb, const Eigen::VectorXd &state_ub)
+{
+    typedef typename crocoddyl::MathBaseTpl<Scalar>::VectorXs VectorXs;
+
+    running = boost::make_shared<crocoddyl::CostModelSumTpl<Scalar>>(state, nu);
+    terminal = boost::make_shared<crocoddyl::CostModelSumTpl<Scalar>>(state, nu);
+
+    x_reg = boost::make_shared<crocoddyl::CostModelStateTpl<Scalar>>(state,
+            boost::make_shared<crocoddyl::ActivationModelQuadTpl<Scalar>>(state->get_ndx()), state->zero(), nu);
+    u_reg = boost::make_shared<crocoddyl::CostModelControlTpl<Scalar>>(state,
+            boost::make_shared<crocoddyl::ActivationModelQuadTpl<Scalar>>(nu), nu);
+
+    goal = boost::make_shared<CostModelPendulumTpl<Scalar, NJoints>>(state,
+            boost::make_shared<crocoddyl::ActivationModelWeightedQuadTpl<Scalar>>(weights.goal.template cast<Scalar>()), nu);
+    goal->setReference(state->zero());
+
+    //The unbounded limits are the double max, which does not fit a float.
+    const double limit = std::numeric_limits<Scalar>::max();
+    const VectorXs lb = state_lb.cwiseMax(-limit).template cast<Scalar>();
+    const VectorXs ub = state_ub.cwiseMin(limit).template cast<Scalar>();
+    joint_limits = boost::make_shared<crocoddyl::CostModelStateTpl<Scalar>>(state,
+            boost::make_shared<crocoddyl::ActivationModelQuadraticBarrierTpl<Scalar>>(crocoddyl::ActivationBoundsTpl<Scalar>(lb, ub)),
+            state->zero(), nu);
+
+    if(weights.u_reg != 0) terminal->addCost("u_reg", u_reg, weights.u_reg);
+    if(weights.x_reg != 0) terminal->addCost("x_reg", x_reg, weights.x_reg);
+
+    if(weights.joint_limit != 0){
+        running-> addCost("joint_limits", joint_limits, weights.joint_limit);
+        terminal->addCost("joint_limits", joint_limits, weights.joint_limit);
+    }
+
+    running-> addCost("x_goal", goal, weights.running_goal);
+    terminal->addCost("x_goal", goal, weights.terminal_goal);
+}
+
+template<typename Scalar>
+PendulumModelsTpl<Scalar>::PendulumModelsTpl(const boost::shared_ptr<crocoddyl::StateMultibodyTpl<Scalar>> &state,
+                                             const boost::shared_ptr<crocoddyl::ActuationModelAbstractTpl<Scalar>> &actuation,
+                                             const boost::shared_ptr<crocoddyl::CostModelSumTpl<Scalar>> &running_costs,
+                                             const boost::shared_ptr<crocoddyl::CostModelSumTpl<Scalar>> &terminal_costs,
+                                             int T, Scalar dt, const VectorXs &u_lb, const VectorXs &u_ub, pendulum_integrator integrator)
+{
+    auto integrate = [&](const boost::shared_ptr<DifferentialModel> &diff_model) -> boost::shared_ptr<ActionModel> {
+        boost::shared_ptr<ActionModel> model;
+        if(integrator == RK4_INTEGRATOR) model = boost::make_shared<crocoddyl::IntegratedActionModelRK4Tpl<Scalar>>(diff_model, dt);
+        else model = boost::make_shared<crocoddyl::IntegratedActionModelEulerTpl<Scalar>>(diff_model, dt);
+        model->set_u_lb(u_lb);
+        model->set_u_ub(u_ub);
+        return model;
+    };
+
+    for(int i = 0; i < T - 1; ++i)
+    {
+        boost::shared_ptr<DifferentialModel> diff_model = boost::make_shared<DifferentialModel>(state, actuation, running_costs);
+        diff_model->set_u_lb(u_lb);
+        diff_model->set_u_ub(u_ub);
+
+        differential_running.push_back(diff_model);
+        running.push_back(integrate(diff_model));
+    }
+
+    differential_terminal = boost::make_shared<DifferentialModel>(state, actuation, terminal_costs);
+    differential_terminal->set_u_lb(u_lb);
+    differential_terminal->set_u_ub(u_ub);
+    terminal = integrate(differential_terminal);
+}
+
+template<typename Scalar>
+boost::shared_ptr<crocoddyl::ShootingProblemTpl<Scalar>> PendulumModelsTpl<Scalar>::createProblem(const VectorXs &x0) const
+{
+    return boost::make_shared<crocoddyl::ShootingProblemTpl<Scalar>>(x0, running, terminal);
+}
+
+template struct PendulumCostsTpl<double, 2>;
+template struct PendulumCostsTpl<double, 3>;
+template struct PendulumCostsTpl<double, 4>;
+template struct PendulumCostsTpl<double, 5>;
+
+template struct PendulumCostsTpl<float, 2>;
+template struct PendulumCostsTpl<float, 3>;
+template struct PendulumCostsTpl<float, 4>;
+template struct PendulumCostsTpl<float, 5>;
+
+template struct PendulumModelsTpl<double>;
+template struct PendulumModelsTpl<float>;
@@ -0,0 +1,81 @@
+#ifndef DoublePENDULUM_PENDULUMPROBLEM_H
+#define DoublePENDULUM_PENDULUMPROBLEM_H
+
+#include "crocoddyl/core/activations/quadratic.hpp"
+#include "crocoddyl/core/activations/quadratic-barrier.hpp"
+#include "crocoddyl/core/integrator/rk4.hpp"
+
+#include "ActuationModelDoublePendulum.h"
+#include "CostModelDoublePendulum.h"
+
+#include <vector>
+
+enum pendulum_integrator{
+    EULER_INTEGRATOR = 0,
+    RK4_INTEGRATOR = 1
+};
+
+// Weights of the pendulum costs. A 0 weight leaves the cost out of the sums.
+struct PendulumCostWeights
+{
+    Eigen::VectorXd goal;  // activation weights of the goal residual, 3 per joint
+    double running_goal;
+    double terminal_goal;
+    double x_reg;          // terminal node only
+    double u_reg;          // terminal node only
+    double joint_limit;
+};
+
+// Bounds of the joint limits barrier: the URDF position limits of the joints that have them
+// and the URDF velocity limit, or max_joint_velocity where the URDF leaves it at 0. The
+// unbounded entries are the double max.
+void pendulumStateLimits(const pinocchio::Model &model, double max_joint_velocity, Eigen::VectorXd &lb, Eigen::VectorXd &ub);
+
+// Cost sums of the swing up and balance problems of a chain of NJoints joints: the periodic
+// goal cost on every node, the regularizations on the terminal one and the joint limits
+// barrier on all of them. The goal reference starts at the zero state.
+template<typename _Scalar, int NJoints>
+struct PendulumCostsTpl
+{
+    typedef _Scalar Scalar;
+    typedef crocoddyl::StateMultibodyTpl<Scalar> StateMultibody;
+
+    boost::shared_ptr<crocoddyl::CostModelSumTpl<Scalar>> running;
+    boost::shared_ptr<crocoddyl::CostModelSumTpl<Scalar>> terminal;
+    boost::shared_ptr<CostModelPendulumTpl<Scalar, NJoints>> goal;
+    boost::shared_ptr<crocoddyl::CostModelStateTpl<Scalar>> x_reg;
+    boost::shared_ptr<crocoddyl::CostModelControlTpl<Scalar>> u_reg;
+    boost::shared_ptr<crocoddyl::CostModelStateTpl<Scalar>> joint_limits;
+
+    // The state limits come from pendulumStateLimits and are clamped to what Scalar can hold.
+    PendulumCostsTpl(const boost::shared_ptr<StateMultibody> &state, std::size_t nu, const PendulumCostWeights &weights,
+                     const Eigen::VectorXd &state_lb, const Eigen::VectorXd &state_ub);
+};
+
+// Action models of a shooting problem of T nodes. Every running node has its own differential
+// model on the shared running costs. The torque limits go on the differential and on the
+// integrated models, the box solvers read them from the integrated ones.
+template<typename _Scalar>
+struct PendulumModelsTpl
+{
+    typedef _Scalar Scalar;
+    typedef typename crocoddyl::MathBaseTpl<Scalar>::VectorXs VectorXs;
+    typedef crocoddyl::DifferentialActionModelFreeFwdDynamicsTpl<Scalar> DifferentialModel;
+    typedef crocoddyl::ActionModelAbstractTpl<Scalar> ActionModel;
+
+    std::vector<boost::shared_ptr<DifferentialModel>> differential_running;
+    std::vector<boost::shared_ptr<ActionModel>> running;
+    boost::shared_ptr<DifferentialModel> differential_terminal;
+    boost::shared_ptr<ActionModel> terminal;
+
+    PendulumModelsTpl(const boost::shared_ptr<crocoddyl::StateMultibodyTpl<Scalar>> &state,
+                      const boost::shared_ptr<crocoddyl::ActuationModelAbstractTpl<Scalar>> &actuation,
+                      const boost::shared_ptr<crocoddyl::CostModelSumTpl<Scalar>> &running_costs,
+                      const boost::shared_ptr<crocoddyl::CostModelSumTpl<Scalar>> &terminal_costs,
+                      int T, Scalar dt, const VectorXs &u_lb, const VectorXs &u_ub,
+                      pendulum_integrator integrator = EULER_INTEGRATOR);
+
+    boost::shared_ptr<crocoddyl::ShootingProblemTpl<Scalar>> createProblem(const VectorXs &x0) const;
+};
+
+#endif
@@ -0,0 +1,132 @@
+#include "RigHost.h"
+
+RigHost::RigHost(std::string host_config_path) : robot(nullptr)
+{
+    YAML::Node host_config = YAML::LoadFile(host_config_path);
+
+    for(auto const& rig_config: host_config["rigs"])
+    {
+        std::unique_ptr<Rig> rig(new Rig());
+        rig->controller.reset(new Controller(rig_config["model"].as<std::string>(), rig_config["config"].as<std::string>()));
+        //The rigs already share the cores through the host pool, a pool per controller would oversubscribe them.
+        rig->controller->setSolverThreads(1);
+        rig->odrive_index = rig_config["odrive"].as<int>();
+        rig->period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(rig->controller->getTimeStep()));
+        rig->busy = false;
+        rig->stopped = false;
+        rig->ticks = 0;
+        rig->deadline_misses = 0;
+        rig->skipped_releases = 0;
+        rig->latency_sum = 0;
+        rig->latency_max = 0;
+        rigs.push_back(std::move(rig));
+    }
+
+    int threads = host_config["threads"].as<int>(std::thread::hardware_concurrency());
+    pool.reset(new WorkStealingPool(threads));
+
+    std::cout << "Hosting " << rigs.size() << " rigs on " << pool->size() << " threads." << std::endl;
+}
+
+RigHost::~RigHost()
+{
+    //Controllers first, they point to the ODrives of the robot.
+    rigs.clear();
+    if(robot) delete robot;
+}
+
+void RigHost::prepare()
+{
+    //All the rigs share the USB enumeration.
+    robot = new Robot(rigs[0]->controller->getTimeStep());
+
+    for(auto &rig: rigs)
+    {
+        Controller &c = *rig->controller;
+        c.connectODrive(robot, rig->odrive_index);
+
+        c.createDOCP(true);
+        c.createTrajectory();
+        c.initGraphs();
+
+        c.createDOCP(false);
+        c.startControl();
+    }
+}
+
+void RigHost::runTick(Rig &rig, std::chrono::steady_clock::time_point release, std::chrono::steady_clock::time_point deadline)
+{
+    if(!rig.controller->controlTick()){
+        rig.controller->stopMotors();
+        rig.stopped = true;
+    }
+
+    auto done = std::chrono::steady_clock::now();
+    double latency = std::chrono::duration<double, std::micro>(done - release).count();
+
+    rig.ticks++;
+    rig.latency_sum += latency;
+    rig.latency_max = std::max(rig.latency_max, latency);
+    if(done > deadline) rig.deadline_misses++;
+
+    rig.busy.store(false, std::memory_order_release);
+}
+
+void RigHost::run()
+{
+    auto start = std::chrono::steady_clock::now();
+    for(auto &rig: rigs)
+        rig->next_release = start;
+
+    while(!Controller::signalFlag)
+    {
+        auto now = std::chrono::steady_clock::now();
+        auto next_wakeup = now + std::chrono::seconds(1);
+        bool any_running = false;
+
+        for(int i = 0; i < (int)rigs.size(); i++)
+        {
+            Rig &rig = *rigs[i];
+            if(rig.stopped) continue;
+            any_running = true;
+
+            if(now >= rig.next_release)
+            {
+                auto release = rig.next_release;
+                auto deadline = release + rig.period;
+
+                //A tick still running means the previous deadline was already missed, skip this release.
+                if(!rig.busy.exchange(true, std::memory_order_acquire)){
+                    //Each rig starts on its own worker, to keep its problem in that core cache.
+                    pool->submit(deadline, [this, &rig, release, deadline]{ runTick(rig, release, deadline); }, i);
+                }else{
+                    rig.skipped_releases++;
+                }
+                rig.next_release += rig.period;
+            }
+            next_wakeup = std::min(next_wakeup, rig.next_release);
+        }
+
+        if(!any_running) break;
+        std::this_thread::sleep_until(next_wakeup);
+    }
+
+    pool->waitIdle();
+
+    for(auto &rig: rigs)
+        if(!rig->stopped) rig->controller->stopMotors();
+}
+
+void RigHost::printMetrics()
+{
+    for(int i = 0; i < (int)rigs.size(); i++)
+    {
+        Rig &rig = *rigs[i];
+        std::cout << "Rig " << i << " (ODrive " << rig.odrive_index << "): " << rig.ticks << " ticks, latency mean "
+        << rig.latency_sum / std::max(rig.ticks, 1L) << "us max " << rig.latency_max << "us, "
+        << rig.deadline_misses << " deadline misses, " << rig.skipped_releases << " skipped releases." << std::endl;
+
+        rig.controller->printControlSummary();
+    }
+}
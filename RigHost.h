@@ -0,0 +1,49 @@
+#ifndef DoublePENDULUM_RIGHOST_H
+#define DoublePENDULUM_RIGHOST_H
+
+#include "Controller.h"
+#include "WorkStealingPool.h"
+
+// Runs several pendulums from one process. Every rig has its own Controller bound to
+// one ODrive of a shared Robot, and its ticks are released at its own rate on a shared
+// WorkStealingPool with the end of the period as deadline. The MPPI and scenario solves of
+// a rig run on the worker of its tick, the controllers get no pools of their own.
+class RigHost
+{
+private:
+    struct Rig
+    {
+        std::unique_ptr<Controller> controller;
+        int odrive_index;
+        std::chrono::steady_clock::duration period;
+        std::chrono::steady_clock::time_point next_release;
+
+        // Only the task running the current tick touches the controller and the metrics.
+        std::atomic<bool> busy;
+        std::atomic<bool> stopped;
+
+        long ticks;
+        long deadline_misses;
+        long skipped_releases;
+        double latency_sum;
+        double latency_max;
+    };
+
+    Robot *robot;
+    std::vector<std::unique_ptr<Rig>> rigs;
+    std::unique_ptr<WorkStealingPool> pool;
+
+    void runTick(Rig &rig, std::chrono::steady_clock::time_point release, std::chrono::steady_clock::time_point deadline);
+
+public:
+    explicit RigHost(std::string host_config_path);
+    ~RigHost();
+
+    // Generates every rig trajectory and builds its MPC problem.
+    void prepare();
+
+    void run();
+    void printMetrics();
+};
+
+#endif
@@ -0,0 +1,256 @@
+#include "ScenarioMPC.h"
+#include "CostModelDoublePendulum.h"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+CostModelConsensus::CostModelConsensus(const boost::shared_ptr<crocoddyl::StateMultibody> &state, const std::size_t &nu) :
+    crocoddyl::CostModelAbstract(state, boost::make_shared<crocoddyl::ActivationModelQuad>(nu), nu),
+    target(Eigen::VectorXd::Zero(nu))
+{
+}
+
+void CostModelConsensus::calc(const boost::shared_ptr<crocoddyl::CostDataAbstract> &data, const Eigen::Ref<const Eigen::VectorXd> &x,
+                              const Eigen::Ref<const Eigen::VectorXd> &u)
+{
+    data->r = u - target;
+    activation_->calc(data->activation, data->r);
+    data->cost = data->activation->a_value;
+}
+
+void CostModelConsensus::calcDiff(const boost::shared_ptr<crocoddyl::CostDataAbstract> &data, const Eigen::Ref<const Eigen::VectorXd> &x,
+                                  const Eigen::Ref<const Eigen::VectorXd> &u)
+{
+    activation_->calcDiff(data->activation, data->r);
+    data->Lu = data->activation->Ar;
+    data->Luu.diagonal() = data->activation->Arr.diagonal();
+}
+
+void CostModelConsensus::setTarget(const Eigen::Ref<const Eigen::VectorXd> &target)
+{
+    this->target = target;
+}
+
+ScenarioMPC::ScenarioMPC(const pinocchio::Model &model, actuated_link act_link, const boost::shared_ptr<crocoddyl::CostModelSum> &running_costs,
+                         const boost::shared_ptr<crocoddyl::CostModelSum> &terminal_costs, int T, double dt, int scenario_count,
+                         const ScenarioSpread &spread, double consensus_weight, int consensus_rounds, int threads,
+                         const Eigen::VectorXd &u_lb, const Eigen::VectorXd &u_ub) :
+    running_costs(running_costs), consensus_weight(consensus_weight), consensus_rounds(std::max(consensus_rounds, 1)),
+    u_lb(u_lb), u_ub(u_ub), pool(threads), solve_iterations(0), warm_start_valid(false), primal_residual(0), solves(0), residual_sum(0)
+{
+    //Fixed seed, the same config always builds the same scenarios.
+    std::mt19937 generator(0);
+    std::uniform_real_distribution<double> symmetric(-1, 1);
+    std::uniform_real_distribution<double> positive(0, 1);
+
+    const std::size_t nu = u_lb.size();
+    scenarios.resize(std::max(scenario_count, 1));
+
+    for(std::size_t s = 0; s < scenarios.size(); s++)
+    {
+        Scenario &scenario = scenarios[s];
+        const bool nominal = s == 0;
+
+        pinocchio::Model scenario_model = model;
+        for(std::size_t j = 1; j < scenario_model.inertias.size(); j++)
+        {
+            const pinocchio::Inertia &inertia = scenario_model.inertias[j];
+            const double scale = nominal ? 1 : 1 + spread.mass * symmetric(generator);
+            scenario_model.inertias[j] = pinocchio::Inertia(scale * inertia.mass(), inertia.lever(), scale * inertia.inertia().matrix());
+        }
+
+        scenario.state = boost::make_shared<crocoddyl::StateMultibody>(boost::make_shared<pinocchio::Model>(scenario_model));
+        scenario.actuation = boost::make_shared<ActuationModelDoublePendulum>(scenario.state, 2, scenario_model.nv, act_link);
+
+        Eigen::VectorXd viscous = Eigen::VectorXd::Zero(scenario_model.nv);
+        Eigen::VectorXd coulomb = Eigen::VectorXd::Zero(scenario_model.nv);
+        Eigen::VectorXd torque_scale = Eigen::VectorXd::Ones(nu);
+        if(!nominal)
+        {
+            for(int i = 0; i < scenario_model.nv; i++){
+                viscous[i] = spread.viscous_friction * positive(generator);
+                coulomb[i] = spread.coulomb_friction * positive(generator);
+            }
+            for(std::size_t i = 0; i < nu; i++)
+                torque_scale[i] = 1 + spread.torque_constant * symmetric(generator);
+        }
+        scenario.actuation->setFriction(viscous, coulomb, spread.friction_smoothing);
+        scenario.actuation->setTorqueScale(torque_scale);
+
+        //The first node has the running costs plus the consensus one, the rest share the nominal sums.
+        scenario.first_costs = boost::make_shared<crocoddyl::CostModelSum>(scenario.state, nu);
+        for(auto const& item: running_costs->get_costs())
+            scenario.first_costs->addCost(item.first, item.second->cost, item.second->weight);
+        scenario.consensus = boost::make_shared<CostModelConsensus>(scenario.state, nu);
+        scenario.first_costs->addCost("consensus", scenario.consensus, consensus_weight);
+
+        std::vector<boost::shared_ptr<crocoddyl::ActionModelAbstract>> running_models;
+        for(int i = 0; i < T; i++)
+        {
+            boost::shared_ptr<crocoddyl::DifferentialActionModelFreeFwdDynamics> diff_model =
+            boost::make_shared<crocoddyl::DifferentialActionModelFreeFwdDynamics>(scenario.state, scenario.actuation,
+                i == 0 ? scenario.first_costs : (i < T - 1 ? running_costs : terminal_costs));
+            diff_model->set_u_lb(u_lb);
+            diff_model->set_u_ub(u_ub);
+
+            scenario.differential_models.push_back(diff_model);
+            running_models.push_back(boost::make_shared<crocoddyl::IntegratedActionModelEuler>(diff_model, dt));
+        }
+        boost::shared_ptr<crocoddyl::ActionModelAbstract> terminal_model = running_models.back();
+        running_models.pop_back();
+
+        scenario.problem = boost::make_shared<crocoddyl::ShootingProblem>(scenario.state->zero(), running_models, terminal_model);
+        scenario.solver = boost::make_shared<crocoddyl::SolverBoxFDDP>(scenario.problem);
+
+        scenario.warm_start_xs.resize(T, scenario.state->zero());
+        scenario.warm_start_us.resize(T - 1, Eigen::VectorXd::Zero(nu));
+        scenario.dual = Eigen::VectorXd::Zero(nu);
+        scenario.target = Eigen::VectorXd::Zero(nu);
+    }
+
+    auto goal = running_costs->get_costs().find("x_goal");
+    if(goal != running_costs->get_costs().end()){
+        goal_activation = boost::static_pointer_cast<crocoddyl::ActivationModelWeightedQuad>(goal->second->cost->get_activation());
+        goal_activation_data = goal_activation->createData();
+        goal_residual = Eigen::VectorXd::Zero(goal_activation->get_nr());
+    }
+
+    consensus_u = Eigen::VectorXd::Zero(nu);
+    us.resize(T - 1, Eigen::VectorXd::Zero(nu));
+
+    std::cout << "Scenario MPC with " << scenarios.size() << " scenarios on " << pool.size() << " threads." << std::endl;
+}
+
+void ScenarioMPC::solveScenario(int s)
+{
+    Scenario &scenario = scenarios[s];
+    scenario.solver->solve(scenario.warm_start_xs, scenario.warm_start_us, solve_iterations, false, 1e-9);
+}
+
+void ScenarioMPC::solve(const Eigen::VectorXd &x0, const std::vector<Eigen::VectorXd> &init_xs,
+                        const std::vector<Eigen::VectorXd> &init_us, int iterations)
+{
+    solves++;
+    solve_iterations = iterations;
+
+    if(!warm_start_valid)
+    {
+        for(auto &scenario: scenarios){
+            std::copy(init_xs.begin(), init_xs.end(), scenario.warm_start_xs.begin());
+            std::copy(init_us.begin(), init_us.end(), scenario.warm_start_us.begin());
+            scenario.dual.setZero();
+        }
+        consensus_u = init_us[0];
+        warm_start_valid = true;
+    }
+
+    for(auto &scenario: scenarios)
+        scenario.problem->set_x0(x0);
+
+    const std::function<void(int, int)> job = [this](int s, int worker){ solveScenario(s); };
+
+    //Consensus ADMM on the first torque. The duals are kept between ticks, the model mismatch
+    //they compensate changes slowly.
+    for(int round = 0; round < consensus_rounds; round++)
+    {
+        for(auto &scenario: scenarios){
+            scenario.target = consensus_u - scenario.dual;
+            scenario.consensus->setTarget(scenario.target);
+        }
+
+        pool.parallelFor(scenarios.size(), job);
+
+        consensus_u.setZero();
+        for(auto const& scenario: scenarios)
+            consensus_u += scenario.solver->get_us()[0] + scenario.dual;
+        consensus_u /= scenarios.size();
+        consensus_u = consensus_u.cwiseMax(u_lb).cwiseMin(u_ub);
+
+        primal_residual = 0;
+        for(auto &scenario: scenarios){
+            scenario.dual += scenario.solver->get_us()[0] - consensus_u;
+            primal_residual = std::max(primal_residual, (scenario.solver->get_us()[0] - consensus_u).lpNorm<Eigen::Infinity>());
+
+            std::copy(scenario.solver->get_xs().begin(), scenario.solver->get_xs().end(), scenario.warm_start_xs.begin());
+            std::copy(scenario.solver->get_us().begin(), scenario.solver->get_us().end(), scenario.warm_start_us.begin());
+        }
+    }
+    residual_sum += primal_residual;
+
+    std::copy(scenarios[0].solver->get_us().begin(), scenarios[0].solver->get_us().end(), us.begin());
+    us[0] = consensus_u;
+
+    //Every scenario warm starts the next tick from its own plan.
+    for(auto &scenario: scenarios){
+        const std::vector<Eigen::VectorXd> &xs = scenario.solver->get_xs();
+        const std::vector<Eigen::VectorXd> &scenario_us = scenario.solver->get_us();
+        std::fill(std::copy(xs.begin() + 1, xs.end(), scenario.warm_start_xs.begin()), scenario.warm_start_xs.end(), xs.back());
+        std::fill(std::copy(scenario_us.begin() + 1, scenario_us.end(), scenario.warm_start_us.begin()), scenario.warm_start_us.end(), scenario_us.back());
+    }
+}
+
+void ScenarioMPC::resetWarmStart()
+{
+    warm_start_valid = false;
+}
+
+void ScenarioMPC::syncWeights()
+{
+    for(auto const& scenario: scenarios)
+        for(auto const& item: running_costs->get_costs())
+            scenario.first_costs->get_costs().find(item.first)->second->weight = item.second->weight;
+
+    if(!goal_activation) return;
+
+    //After set_weights the first calcDiff on the activation rewrites its data and clears the
+    //flag, which the scenario threads would race on. Write every data here and clear it first.
+    for(auto const& scenario: scenarios)
+        setGoalActivationData(scenario.problem, goal_activation->get_weights());
+    goal_activation->calcDiff(goal_activation_data, goal_residual);
+}
+
+void ScenarioMPC::set_bounds(const Eigen::VectorXd &u_lb, const Eigen::VectorXd &u_ub)
+{
+    this->u_lb = u_lb;
+    this->u_ub = u_ub;
+    for(auto const& scenario: scenarios){
+        for(auto const& diff_model: scenario.differential_models){
+            diff_model->set_u_lb(u_lb);
+            diff_model->set_u_ub(u_ub);
+        }
+        //SolverBoxFDDP reads the limits from the integrated models, which copied them on construction.
+        for(auto const& model: scenario.problem->get_runningModels()){
+            model->set_u_lb(u_lb);
+            model->set_u_ub(u_ub);
+        }
+        scenario.problem->get_terminalModel()->set_u_lb(u_lb);
+        scenario.problem->get_terminalModel()->set_u_ub(u_ub);
+    }
+}
+
+const std::vector<Eigen::VectorXd>& ScenarioMPC::get_xs() const
+{
+    return scenarios[0].solver->get_xs();
+}
+
+const std::vector<Eigen::VectorXd>& ScenarioMPC::get_us() const
+{
+    return us;
+}
+
+double ScenarioMPC::get_cost() const
+{
+    return scenarios[0].solver->get_cost();
+}
+
+double ScenarioMPC::get_primal_residual() const
+{
+    return primal_residual;
+}
+
+void ScenarioMPC::print()
+{
+    std::cout << "Scenario MPC: " << scenarios.size() << " scenarios, " << solves << " solves, mean consensus residual "
+    << (solves ? residual_sum / solves : 0.0) << " Nm." << std::endl;
+}
@@ -0,0 +1,117 @@
+#ifndef DoublePENDULUM_SCENARIOMPC_H
+#define DoublePENDULUM_SCENARIOMPC_H
+
+#include "crocoddyl/core/activations/quadratic.hpp"
+#include "crocoddyl/core/activations/weighted-quadratic.hpp"
+#include "crocoddyl/core/solvers/box-fddp.hpp"
+
+#include "ActuationModelDoublePendulum.h"
+#include "ThreadPool.h"
+
+// Quadratic pull of the first torque of a scenario towards the consensus,
+// r = u - target.
+class CostModelConsensus : public crocoddyl::CostModelAbstract
+{
+private:
+    Eigen::VectorXd target;
+
+public:
+    CostModelConsensus(const boost::shared_ptr<crocoddyl::StateMultibody> &state, const std::size_t &nu);
+
+    void calc(const boost::shared_ptr<crocoddyl::CostDataAbstract> &data, const Eigen::Ref<const Eigen::VectorXd> &x,
+              const Eigen::Ref<const Eigen::VectorXd> &u) override;
+
+    void calcDiff(const boost::shared_ptr<crocoddyl::CostDataAbstract> &data, const Eigen::Ref<const Eigen::VectorXd> &x,
+                  const Eigen::Ref<const Eigen::VectorXd> &u) override;
+
+    void setTarget(const Eigen::Ref<const Eigen::VectorXd> &target);
+};
+
+// Half width of the uniform spread of each parameter around the nominal model.
+struct ScenarioSpread
+{
+    double mass;             // relative, per link
+    double torque_constant;  // relative, per input
+    double viscous_friction; // Nm s/rad, only added
+    double coulomb_friction; // Nm, only added
+    double friction_smoothing;
+};
+
+// Robust MPC over S variants of the model. Each scenario is the MPC problem on a copy of the
+// pinocchio model with perturbed link masses, friction and torque constants, sharing the cost
+// sums (and so the weights and the goal) of the nominal problem. The scenarios are solved in
+// parallel and agree on one first torque by consensus ADMM: the first node of every scenario
+// has a consensus cost pulling u0 towards the average, and a few rounds of solves and dual
+// updates bring the first torques together. Scenario 0 is the nominal model.
+class ScenarioMPC
+{
+private:
+    struct Scenario
+    {
+        boost::shared_ptr<crocoddyl::StateMultibody> state;
+        boost::shared_ptr<ActuationModelDoublePendulum> actuation;
+        boost::shared_ptr<crocoddyl::CostModelSum> first_costs;
+        boost::shared_ptr<CostModelConsensus> consensus;
+        std::vector<boost::shared_ptr<crocoddyl::DifferentialActionModelFreeFwdDynamics>> differential_models;
+        boost::shared_ptr<crocoddyl::ShootingProblem> problem;
+        boost::shared_ptr<crocoddyl::SolverBoxFDDP> solver;
+
+        std::vector<Eigen::VectorXd> warm_start_xs;
+        std::vector<Eigen::VectorXd> warm_start_us;
+        Eigen::VectorXd dual;
+        Eigen::VectorXd target;
+    };
+
+    std::vector<Scenario> scenarios;
+    boost::shared_ptr<crocoddyl::CostModelSum> running_costs;
+
+    // Goal activation shared by every scenario. Its new weights flag is cleared on a scratch
+    // data in syncWeights, so the parallel solves only ever read it.
+    boost::shared_ptr<crocoddyl::ActivationModelWeightedQuad> goal_activation;
+    boost::shared_ptr<crocoddyl::ActivationDataAbstract> goal_activation_data;
+    Eigen::VectorXd goal_residual;
+
+    double consensus_weight;
+    int consensus_rounds;
+    Eigen::VectorXd u_lb;
+    Eigen::VectorXd u_ub;
+
+    ThreadPool pool;
+    int solve_iterations;
+    bool warm_start_valid;
+
+    Eigen::VectorXd consensus_u;
+    std::vector<Eigen::VectorXd> us;
+    double primal_residual;
+
+    long solves;
+    double residual_sum;
+
+    void solveScenario(int s);
+
+public:
+    ScenarioMPC(const pinocchio::Model &model, actuated_link act_link, const boost::shared_ptr<crocoddyl::CostModelSum> &running_costs,
+                const boost::shared_ptr<crocoddyl::CostModelSum> &terminal_costs, int T, double dt, int scenario_count,
+                const ScenarioSpread &spread, double consensus_weight, int consensus_rounds, int threads,
+                const Eigen::VectorXd &u_lb, const Eigen::VectorXd &u_ub);
+
+    // init_xs and init_us only seed the scenarios after resetWarmStart, afterwards every
+    // scenario warm starts from its own shifted solution.
+    void solve(const Eigen::VectorXd &x0, const std::vector<Eigen::VectorXd> &init_xs,
+               const std::vector<Eigen::VectorXd> &init_us, int iterations);
+    void resetWarmStart();
+
+    // The running costs weights are copied to the first nodes and the goal weights to the
+    // activation data of every node, call it after changing them and never during a solve.
+    void syncWeights();
+    void set_bounds(const Eigen::VectorXd &u_lb, const Eigen::VectorXd &u_ub);
+
+    // Plan of the nominal scenario with the consensus torque as the first one.
+    const std::vector<Eigen::VectorXd>& get_xs() const;
+    const std::vector<Eigen::VectorXd>& get_us() const;
+    double get_cost() const;
+    double get_primal_residual() const;
+    void print();
+};
+
+#endif
@@ -0,0 +1,166 @@
+#include "SessionRecorder.h"
+
+#include <cstring>
+#include <iostream>
+
+static const char SESSION_MAGIC[4] = {'D', 'P', 'S', 'R'};
+static const uint32_t SESSION_VERSION = 2;
+
+SessionTick::SessionTick(int nx, int nu, int T) : tick(0), t(0), measured_state(Eigen::VectorXd::Zero(nx)),
+    x0(Eigen::VectorXd::Zero(nx)), goal_reference(Eigen::VectorXd::Zero(nx)), warm_start_xs(T, Eigen::VectorXd::Zero(nx)),
+    warm_start_us(T - 1, Eigen::VectorXd::Zero(nu)), warm_start_valid(true), previous_torque(Eigen::VectorXd::Zero(nu)),
+    horizon_level(0), iteration_cap(0), torque(Eigen::VectorXd::Zero(nu)),
+    solve_time(0), iterations(0), cost(0), source(0)
+{
+}
+
+SessionRecorder::SessionRecorder(const std::string &path, int nx, int nu, int T, double dt) : file_buffer(1 << 20)
+{
+    file = std::fopen(path.c_str(), "wb");
+    if(!file){
+        std::cout << "Could not open " << path << " to record the session." << std::endl;
+        return;
+    }
+
+    //Big stdio buffer, so most ticks are a memcpy and the disk is only touched every few hundred.
+    std::setvbuf(file, file_buffer.data(), _IOFBF, file_buffer.size());
+
+    int32_t dims[3] = {nx, nu, T};
+    write(SESSION_MAGIC, sizeof(SESSION_MAGIC));
+    write(&SESSION_VERSION, sizeof(SESSION_VERSION));
+    write(dims, sizeof(dims));
+    write(&dt, sizeof(dt));
+
+    std::cout << "Recording the session to " << path << std::endl;
+}
+
+SessionRecorder::~SessionRecorder()
+{
+    if(file) std::fclose(file);
+}
+
+void SessionRecorder::write(const void *data, std::size_t size)
+{
+    if(file) std::fwrite(data, 1, size, file);
+}
+
+void SessionRecorder::write(const Eigen::VectorXd &v)
+{
+    write(v.data(), sizeof(double) * v.size());
+}
+
+void SessionRecorder::writeTickInput(const SessionTick &tick)
+{
+    uint8_t type = TICK_RECORD;
+    uint8_t valid = tick.warm_start_valid;
+
+    write(&type, sizeof(type));
+    write(&tick.tick, sizeof(tick.tick));
+    write(&tick.t, sizeof(tick.t));
+    write(tick.measured_state);
+    write(tick.x0);
+    write(tick.goal_reference);
+    for(auto const& x: tick.warm_start_xs) write(x);
+    for(auto const& u: tick.warm_start_us) write(u);
+    write(&valid, sizeof(valid));
+    write(tick.previous_torque);
+
+    int32_t schedule[2] = {tick.horizon_level, tick.iteration_cap};
+    write(schedule, sizeof(schedule));
+}
+
+void SessionRecorder::writeTickOutput(const SessionTick &tick)
+{
+    int32_t iterations = tick.iterations;
+    int32_t source = tick.source;
+
+    write(tick.torque);
+    write(&tick.solve_time, sizeof(tick.solve_time));
+    write(&iterations, sizeof(iterations));
+    write(&tick.cost, sizeof(tick.cost));
+    write(&source, sizeof(source));
+}
+
+void SessionRecorder::writeParameters(const TunableParameters &parameters)
+{
+    uint8_t type = PARAMETERS_RECORD;
+    write(&type, sizeof(type));
+    write(&parameters, sizeof(parameters));
+}
+
+SessionReader::SessionReader(const std::string &path) : nx(0), nu(0), T(0), dt(0)
+{
+    file = std::fopen(path.c_str(), "rb");
+    if(!file){
+        std::cout << "Could not open the session " << path << std::endl;
+        return;
+    }
+
+    char magic[4];
+    uint32_t version;
+    int32_t dims[3];
+
+    if(!read(magic, sizeof(magic)) || std::memcmp(magic, SESSION_MAGIC, sizeof(magic)) != 0
+       || !read(&version, sizeof(version)) || version != SESSION_VERSION
+       || !read(dims, sizeof(dims)) || !read(&dt, sizeof(dt)))
+    {
+        std::cout << path << " is not a session recorded by this version." << std::endl;
+        std::fclose(file);
+        file = nullptr;
+        return;
+    }
+
+    nx = dims[0];
+    nu = dims[1];
+    T = dims[2];
+}
+
+SessionReader::~SessionReader()
+{
+    if(file) std::fclose(file);
+}
+
+bool SessionReader::isOpen() const
+{
+    return file != nullptr;
+}
+
+bool SessionReader::read(void *data, std::size_t size)
+{
+    return std::fread(data, 1, size, file) == size;
+}
+
+bool SessionReader::read(Eigen::VectorXd &v)
+{
+    return read(v.data(), sizeof(double) * v.size());
+}
+
+int SessionReader::next(SessionTick &tick, TunableParameters &parameters)
+{
+    uint8_t type;
+    if(!file || !read(&type, sizeof(type))) return 0;
+
+    if(type == PARAMETERS_RECORD)
+        return read(&parameters, sizeof(parameters)) ? PARAMETERS_RECORD : 0;
+
+    if(type != TICK_RECORD) return 0;
+
+    uint8_t valid;
+    int32_t schedule[2];
+    int32_t iterations, source;
+    bool ok = read(&tick.tick, sizeof(tick.tick)) && read(&tick.t, sizeof(tick.t))
+        && read(tick.measured_state) && read(tick.x0) && read(tick.goal_reference);
+    for(auto &x: tick.warm_start_xs) ok = ok && read(x);
+    for(auto &u: tick.warm_start_us) ok = ok && read(u);
+    ok = ok && read(&valid, sizeof(valid)) && read(tick.previous_torque) && read(schedule, sizeof(schedule)) && read(tick.torque) && read(&tick.solve_time, sizeof(tick.solve_time))
+        && read(&iterations, sizeof(iterations)) && read(&tick.cost, sizeof(tick.cost)) && read(&source, sizeof(source));
+
+    if(!ok) return 0;
+
+    tick.warm_start_valid = valid;
+    tick.horizon_level = schedule[0];
+    tick.iteration_cap = schedule[1];
+    tick.iterations = iterations;
+    tick.source = source;
+    return TICK_RECORD;
+}
@@ -0,0 +1,94 @@
+#ifndef DoublePENDULUM_SESSIONRECORDER_H
+#define DoublePENDULUM_SESSIONRECORDER_H
+
+#include <Eigen/Dense>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "ConfigWatcher.h"
+
+// Binary session log. After the header the file is a sequence of records, each one
+// starting with its type byte:
+//   TICK_RECORD        everything computeControl needs as input and what it returned
+//   PARAMETERS_RECORD  a TunableParameters applied by a config reload before the next tick
+// All values are written raw in the host byte order.
+enum session_record_type{
+    TICK_RECORD = 1,
+    PARAMETERS_RECORD = 2
+};
+
+struct SessionTick
+{
+    unsigned long tick;
+    double t;
+
+    Eigen::VectorXd measured_state;
+    Eigen::VectorXd x0;
+    Eigen::VectorXd goal_reference;
+
+    std::vector<Eigen::VectorXd> warm_start_xs;
+    std::vector<Eigen::VectorXd> warm_start_us;
+    bool warm_start_valid;
+    // computeControl restarts the warm start controls from it when the warm start is not valid.
+    Eigen::VectorXd previous_torque;
+    // Horizon level and iteration cap picked by the adaptive scheduler.
+    int horizon_level;
+    int iteration_cap;
+
+    Eigen::VectorXd torque;
+    double solve_time;
+    int iterations;
+    double cost;
+    int source;
+
+    SessionTick(int nx, int nu, int T);
+};
+
+class SessionRecorder
+{
+private:
+    FILE *file;
+    std::vector<char> file_buffer;
+
+    void write(const void *data, std::size_t size);
+    void write(const Eigen::VectorXd &v);
+
+public:
+    // T is the number of nodes, the warm start has T states and T - 1 controls.
+    SessionRecorder(const std::string &path, int nx, int nu, int T, double dt);
+    ~SessionRecorder();
+
+    // The tick is written in two parts, the solver input before the solve and its output after.
+    void writeTickInput(const SessionTick &tick);
+    void writeTickOutput(const SessionTick &tick);
+
+    void writeParameters(const TunableParameters &parameters);
+};
+
+class SessionReader
+{
+private:
+    FILE *file;
+
+    bool read(void *data, std::size_t size);
+    bool read(Eigen::VectorXd &v);
+
+public:
+    int nx;
+    int nu;
+    int T;
+    double dt;
+
+    explicit SessionReader(const std::string &path);
+    ~SessionReader();
+
+    bool isOpen() const;
+
+    // Reads the next record into tick or parameters and returns its type, 0 at the end.
+    int next(SessionTick &tick, TunableParameters &parameters);
+};
+
+#endif
@@ -0,0 +1,28 @@
+#include "SimulatedPlant.h"
+
+SimulatedPlant::SimulatedPlant(const boost::shared_ptr<crocoddyl::StateMultibody> &state,
+                               const boost::shared_ptr<crocoddyl::ActuationModelAbstract> &actuation,
+                               const Eigen::VectorXd &x0, double max_step) :
+    nq(state->get_nq()), nv(state->get_nv()), max_step(max_step), x(x0)
+{
+    auto costs = boost::make_shared<crocoddyl::CostModelSum>(state, actuation->get_nu());
+    dynamics = boost::make_shared<crocoddyl::DifferentialActionModelFreeFwdDynamics>(state, actuation, costs);
+    dynamics_data = dynamics->createData();
+}
+
+void SimulatedPlant::readState(Eigen::VectorXd &x_out) const
+{
+    x_out = x;
+}
+
+void SimulatedPlant::step(const Eigen::VectorXd &u, double dt)
+{
+    while(dt > 1e-9)
+    {
+        const double h = std::min(dt, max_step);
+        dynamics->calc(dynamics_data, x, u);
+        x.tail(nv) += h * dynamics_data->xout;
+        x.head(nq) += h * x.tail(nv);
+        dt -= h;
+    }
+}
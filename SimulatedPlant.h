@@ -0,0 +1,35 @@
+#ifndef DoublePENDULUM_SIMULATEDPLANT_H
+#define DoublePENDULUM_SIMULATEDPLANT_H
+
+#include "crocoddyl/core/fwd.hpp"
+#include "crocoddyl/multibody/states/multibody.hpp"
+#include "crocoddyl/multibody/costs/cost-sum.hpp"
+#include "crocoddyl/multibody/actions/free-fwddyn.hpp"
+
+// Stands in for the ODrives when there is no rig. Integrates the same dynamics and
+// actuation as the MPC with small semi-implicit Euler steps, holding each torque for a
+// whole tick like the motors do.
+class SimulatedPlant
+{
+private:
+    boost::shared_ptr<crocoddyl::DifferentialActionModelFreeFwdDynamics> dynamics;
+    boost::shared_ptr<crocoddyl::DifferentialActionDataAbstract> dynamics_data;
+
+    int nq;
+    int nv;
+    double max_step;
+
+    Eigen::VectorXd x;
+
+public:
+    SimulatedPlant(const boost::shared_ptr<crocoddyl::StateMultibody> &state,
+                   const boost::shared_ptr<crocoddyl::ActuationModelAbstract> &actuation,
+                   const Eigen::VectorXd &x0, double max_step);
+
+    void readState(Eigen::VectorXd &x_out) const;
+
+    // Applies u during dt seconds.
+    void step(const Eigen::VectorXd &u, double dt);
+};
+
+#endif
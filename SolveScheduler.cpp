@@ -0,0 +1,98 @@
+#include "SolveScheduler.h"
+
+#include <algorithm>
+#include <iostream>
+
+SolveScheduler::SolveScheduler(const std::vector<int> &horizons, int min_iterations, int max_iterations, double budget,
+                               double high_watermark, double low_watermark, int patience) :
+    horizons(horizons), min_iterations(std::max(min_iterations, 1)), max_iterations(std::max(max_iterations, std::max(min_iterations, 1))),
+    budget(budget), high_watermark(high_watermark), low_watermark(low_watermark), patience(patience), latency_filter(0.1),
+    expected_latency(0), calm_ticks(0), overruns(0), horizon_changes(0), iteration_changes(0)
+{
+    std::sort(this->horizons.begin(), this->horizons.end());
+
+    //Start with everything, the first overruns bring it down.
+    level = (int)this->horizons.size() - 1;
+    iterations = this->max_iterations;
+}
+
+//Solve time grows about linearly with the horizon and the iterations, so after a change
+//the expected latency is scaled instead of waiting for the filter to catch up.
+void SolveScheduler::setLevel(int new_level)
+{
+    expected_latency *= (double)horizons[new_level] / horizons[level];
+    level = new_level;
+    horizon_changes++;
+}
+
+void SolveScheduler::setIterations(int new_iterations)
+{
+    expected_latency *= (double)new_iterations / iterations;
+    iterations = new_iterations;
+    iteration_changes++;
+}
+
+void SolveScheduler::update(double solve_time, bool converged)
+{
+    if(solve_time > budget) overruns++;
+
+    expected_latency += latency_filter * (solve_time - expected_latency);
+
+    //React to a single overrun right away, it already cost a deadline.
+    if(solve_time > budget || expected_latency > high_watermark * budget)
+    {
+        calm_ticks = 0;
+        if(iterations > min_iterations) setIterations(iterations - 1);
+        else if(level > 0) setLevel(level - 1);
+        return;
+    }
+
+    if(expected_latency > low_watermark * budget)
+    {
+        calm_ticks = 0;
+        return;
+    }
+
+    if(++calm_ticks < patience) return;
+    calm_ticks = 0;
+
+    if(!converged && iterations < max_iterations) setIterations(iterations + 1);
+    else if(level < (int)horizons.size() - 1) setLevel(level + 1);
+}
+
+void SolveScheduler::force(int level, int iterations)
+{
+    this->level = std::min(std::max(level, 0), (int)horizons.size() - 1);
+    this->iterations = iterations;
+}
+
+int SolveScheduler::get_level() const
+{
+    return level;
+}
+
+int SolveScheduler::get_horizon() const
+{
+    return horizons[level];
+}
+
+int SolveScheduler::get_iterations() const
+{
+    return iterations;
+}
+
+int SolveScheduler::get_levels() const
+{
+    return horizons.size();
+}
+
+int SolveScheduler::get_horizon(int level) const
+{
+    return horizons[level];
+}
+
+void SolveScheduler::print()
+{
+    std::cout << "Adaptive scheduler: horizon " << horizons[level] << " nodes, " << iterations << " iterations. "
+    << horizon_changes << " horizon and " << iteration_changes << " iteration changes, " << overruns << " overruns." << std::endl;
+}
@@ -0,0 +1,57 @@
+#ifndef DoublePENDULUM_SOLVESCHEDULER_H
+#define DoublePENDULUM_SOLVESCHEDULER_H
+
+#include <vector>
+
+// Picks the MPC horizon and iteration cap of the next tick from the measured solve
+// latency. Over budget it first gives up iterations and then horizon, with time to
+// spare it gives iterations back while the solver stops at the cap and horizon once it
+// converges. Horizons are levels of a fixed list, so the problems can be built up front.
+class SolveScheduler
+{
+private:
+    std::vector<int> horizons;
+    int level;
+
+    int iterations;
+    int min_iterations;
+    int max_iterations;
+
+    double budget;
+    double high_watermark;
+    double low_watermark;
+    int patience;
+    double latency_filter;
+
+    // Expected latency of the next solve, in seconds.
+    double expected_latency;
+    int calm_ticks;
+
+    long overruns;
+    long horizon_changes;
+    long iteration_changes;
+
+    void setLevel(int new_level);
+    void setIterations(int new_iterations);
+
+public:
+    // budget is the time a solve may take, in seconds. The watermarks are fractions of it.
+    SolveScheduler(const std::vector<int> &horizons, int min_iterations, int max_iterations, double budget,
+                   double high_watermark, double low_watermark, int patience);
+
+    // Called after every MPC solve with its latency in seconds and whether it converged.
+    void update(double solve_time, bool converged);
+
+    // Used by the replay to reproduce a recorded tick.
+    void force(int level, int iterations);
+
+    int get_level() const;
+    int get_horizon() const;
+    int get_iterations() const;
+    int get_levels() const;
+    int get_horizon(int level) const;
+
+    void print();
+};
+
+#endif
@@ -0,0 +1,266 @@
+#include "SolverCondensedQP.h"
+#include "CostModelDoublePendulum.h"
+
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+SolverCondensedQP::SolverCondensedQP(const boost::shared_ptr<crocoddyl::ShootingProblem> &problem, int max_qp_iterations) :
+    problem(problem), cost(0), cost_try(0), max_qp_iterations(max_qp_iterations), reg(1e-9), reg_min(1e-9), reg_max(1e9),
+    th_stop(1e-9), expected_improvement(0), iter(0), solves(0), qp_iterations(0)
+{
+    const auto &running_models = problem->get_runningModels();
+    T = problem->get_T();
+    ndx = running_models[0]->get_state()->get_ndx();
+    nu = running_models[0]->get_nu();
+    n = T * nu;
+
+    for(std::size_t t = 0; t < T; t++)
+        running_datas.push_back(running_models[t]->createData());
+    terminal_data = problem->get_terminalModel()->createData();
+
+    xs.resize(T + 1, problem->get_x0());
+    xs_try.resize(T + 1, problem->get_x0());
+    us.resize(T, Eigen::VectorXd::Zero(nu));
+    us_try.resize(T, Eigen::VectorXd::Zero(nu));
+
+    Su = Eigen::MatrixXd::Zero(ndx * (T + 1), n);
+    Lxx_Su = Eigen::MatrixXd::Zero(ndx, n);
+    Su_Lxu = Eigen::MatrixXd::Zero(n, nu);
+
+    H = Eigen::MatrixXd::Zero(n, n);
+    g = Eigen::VectorXd::Zero(n);
+    du = Eigen::VectorXd::Zero(n);
+    du_lb = Eigen::VectorXd::Zero(n);
+    du_ub = Eigen::VectorXd::Zero(n);
+
+    H_free = Eigen::MatrixXd::Zero(n, n);
+    llt = Eigen::LLT<Eigen::MatrixXd>(n);
+    qp_gradient = Eigen::VectorXd::Zero(n);
+    du_clamped = Eigen::VectorXd::Zero(n);
+    du_newton = Eigen::VectorXd::Zero(n);
+    du_candidate = Eigen::VectorXd::Zero(n);
+    H_du = Eigen::VectorXd::Zero(n);
+    clamped.resize(n, false);
+
+    std::cout << "Condensed QP solver with " << n << " decision variables." << std::endl;
+}
+
+//Single shooting rollout, leaves the datas linearizable at (xs_out, us_in).
+double SolverCondensedQP::rollout(const std::vector<Eigen::VectorXd> &us_in, std::vector<Eigen::VectorXd> &xs_out)
+{
+    const auto &running_models = problem->get_runningModels();
+
+    double total = 0;
+    xs_out[0] = problem->get_x0();
+    for(std::size_t t = 0; t < T; t++)
+    {
+        running_models[t]->calc(running_datas[t], xs_out[t], us_in[t]);
+        total += running_datas[t]->cost;
+        xs_out[t + 1] = running_datas[t]->xnext;
+    }
+    problem->get_terminalModel()->calc(terminal_data, xs_out[T]);
+    total += terminal_data->cost;
+
+    return std::isfinite(total) ? total : std::numeric_limits<double>::infinity();
+}
+
+//dx_{t+1} = Fx dx_t + Fu du_t with dx_0 = 0, so every dx_t = Su_t du and only depends on the
+//torques before t. Substituting it in the quadratic model of every node gives H and g.
+void SolverCondensedQP::condense()
+{
+    const auto &running_models = problem->get_runningModels();
+
+    H.setZero();
+    g.setZero();
+
+    for(std::size_t t = 0; t < T; t++)
+    {
+        const boost::shared_ptr<crocoddyl::ActionDataAbstract> &data = running_datas[t];
+        running_models[t]->calcDiff(data, xs[t], us[t]);
+
+        const long m = t * nu;
+        const auto Su_t = Su.block(t * ndx, 0, ndx, m);
+
+        Lxx_Su.leftCols(m).noalias() = data->Lxx * Su_t;
+        H.topLeftCorner(m, m).noalias() += Su_t.transpose() * Lxx_Su.leftCols(m);
+        g.head(m).noalias() += Su_t.transpose() * data->Lx;
+
+        Su_Lxu.topRows(m).noalias() = Su_t.transpose() * data->Lxu;
+        H.block(0, m, m, nu) += Su_Lxu.topRows(m);
+        H.block(m, 0, nu, m) += Su_Lxu.topRows(m).transpose();
+        H.block(m, m, nu, nu) += data->Luu;
+        g.segment(m, nu) += data->Lu;
+
+        Su.block((t + 1) * ndx, 0, ndx, m).noalias() = data->Fx * Su_t;
+        Su.block((t + 1) * ndx, m, ndx, nu) = data->Fu;
+    }
+
+    problem->get_terminalModel()->calcDiff(terminal_data, xs[T]);
+    const auto Su_T = Su.bottomRows(ndx);
+    Lxx_Su.noalias() = terminal_data->Lxx * Su_T;
+    H.noalias() += Su_T.transpose() * Lxx_Su;
+    g.noalias() += Su_T.transpose() * terminal_data->Lx;
+}
+
+double SolverCondensedQP::qpValue(const Eigen::VectorXd &x)
+{
+    H_du.noalias() = H * x;
+    return 0.5 * x.dot(H_du) + g.dot(x);
+}
+
+//Projected Newton: the bounds that push outwards are clamped, a Newton step is taken on the
+//free torques and projected back into the box. It starts from du = 0, so the torques the warm
+//start already has on a bound start clamped. Returns false when the free Hessian is not
+//positive definite.
+bool SolverCondensedQP::solveQP()
+{
+    du.setZero();
+
+    for(int k = 0; k < max_qp_iterations; k++)
+    {
+        qp_iterations++;
+
+        qp_gradient.noalias() = H * du;
+        qp_gradient += g;
+
+        //With a margin, a torque a rounding error away from its bound is still on it.
+        for(std::size_t i = 0; i < n; i++){
+            clamped[i] = (du[i] <= du_lb[i] + 1e-10 && qp_gradient[i] > 0) || (du[i] >= du_ub[i] - 1e-10 && qp_gradient[i] < 0);
+            du_clamped[i] = clamped[i] ? du[i] : 0;
+        }
+
+        //H_ff du_f = -(g_f + H_fc du_c), the clamped rows keep their value.
+        H_free = H;
+        du_newton = -g;
+        du_newton.noalias() -= H * du_clamped;
+        for(std::size_t i = 0; i < n; i++){
+            if(!clamped[i]) continue;
+            H_free.row(i).setZero();
+            H_free.col(i).setZero();
+            H_free(i, i) = 1;
+            du_newton[i] = du[i];
+        }
+
+        llt.compute(H_free);
+        if(llt.info() != Eigen::Success) return false;
+        llt.solveInPlace(du_newton);
+
+        const double value = qpValue(du);
+        double step = 1;
+        while(true)
+        {
+            du_candidate = (du + step * (du_newton - du)).cwiseMax(du_lb).cwiseMin(du_ub);
+            if(qpValue(du_candidate) <= value) break;
+            step *= 0.5;
+            if(step < 1e-6) return true;
+        }
+
+        const double change = (du_candidate - du).lpNorm<Eigen::Infinity>();
+        du = du_candidate;
+        if(change < 1e-9) break;
+    }
+    return true;
+}
+
+bool SolverCondensedQP::solve(const std::vector<Eigen::VectorXd> &init_us, std::size_t maxiter)
+{
+    const auto &running_models = problem->get_runningModels();
+    solves++;
+
+    for(std::size_t t = 0; t < T; t++)
+        us[t] = init_us[t].cwiseMax(running_models[t]->get_u_lb()).cwiseMin(running_models[t]->get_u_ub());
+    cost = rollout(us, xs);
+
+    for(iter = 0; iter < maxiter; iter++)
+    {
+        condense();
+
+        for(std::size_t t = 0; t < T; t++){
+            du_lb.segment(t * nu, nu) = running_models[t]->get_u_lb() - us[t];
+            du_ub.segment(t * nu, nu) = running_models[t]->get_u_ub() - us[t];
+        }
+
+        //Levenberg-Marquardt: the pendulum cost is not convex far from the goal.
+        H.diagonal().array() += reg;
+        while(!solveQP())
+        {
+            if(reg >= reg_max) return false;
+            const double new_reg = std::min(10 * reg, reg_max);
+            H.diagonal().array() += new_reg - reg;
+            reg = new_reg;
+        }
+
+        expected_improvement = -qpValue(du);
+        if(expected_improvement < th_stop) return true;
+
+        bool accepted = false;
+        for(double alpha = 1; alpha > 1e-3; alpha *= 0.5)
+        {
+            for(std::size_t t = 0; t < T; t++)
+                us_try[t] = (us[t] + alpha * du.segment(t * nu, nu)).cwiseMax(running_models[t]->get_u_lb()).cwiseMin(running_models[t]->get_u_ub());
+            cost_try = rollout(us_try, xs_try);
+
+            if(cost - cost_try >= 1e-4 * alpha * expected_improvement)
+            {
+                std::swap(xs, xs_try);
+                std::swap(us, us_try);
+                cost = cost_try;
+                accepted = true;
+                if(alpha == 1) reg = std::max(reg / 10, reg_min);
+                break;
+            }
+        }
+
+        if(!accepted)
+        {
+            reg = std::min(10 * reg, reg_max);
+            //The datas hold the last rejected rollout.
+            cost = rollout(us, xs);
+            if(reg >= reg_max) return false;
+        }
+    }
+    return false;
+}
+
+void SolverCondensedQP::set_th_stop(double th_stop)
+{
+    this->th_stop = th_stop;
+}
+
+void SolverCondensedQP::setGoalWeights(const Eigen::VectorXd &weights)
+{
+    for(auto const& data: running_datas) setGoalActivationData<double>(data, weights);
+    setGoalActivationData<double>(terminal_data, weights);
+}
+
+const std::vector<Eigen::VectorXd>& SolverCondensedQP::get_xs() const
+{
+    return xs;
+}
+
+const std::vector<Eigen::VectorXd>& SolverCondensedQP::get_us() const
+{
+    return us;
+}
+
+double SolverCondensedQP::get_cost() const
+{
+    return cost;
+}
+
+std::size_t SolverCondensedQP::get_iter() const
+{
+    return iter;
+}
+
+double SolverCondensedQP::get_expected_improvement() const
+{
+    return expected_improvement;
+}
+
+void SolverCondensedQP::print()
+{
+    std::cout << "Condensed QP solver: " << solves << " solves, " << (solves ? (double)qp_iterations / solves : 0.0)
+    << " QP iterations per solve." << std::endl;
+}
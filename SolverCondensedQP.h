@@ -0,0 +1,92 @@
+#ifndef DoublePENDULUM_SOLVERCONDENSEDQP_H
+#define DoublePENDULUM_SOLVERCONDENSEDQP_H
+
+#include "crocoddyl/core/fwd.hpp"
+#include "crocoddyl/core/optctrl/shooting.hpp"
+
+#include <Eigen/Cholesky>
+
+// Single shooting SQP for short horizons. Every iteration linearizes the rollout, condenses
+// the states away into one dense QP over the stacked torques,
+//   min 0.5 du' H du + g' du   s.t.   u_lb - u <= du <= u_ub - u
+// solves it with a projected Newton active set method and line searches the step on the
+// nonlinear cost. Everything is sized in the constructor, so a solve does not allocate.
+// Building H grows with the square of the horizon, so it only pays off for short ones.
+class SolverCondensedQP
+{
+private:
+    boost::shared_ptr<crocoddyl::ShootingProblem> problem;
+
+    std::size_t T;
+    std::size_t ndx;
+    std::size_t nu;
+    std::size_t n;
+
+    std::vector<boost::shared_ptr<crocoddyl::ActionDataAbstract>> running_datas;
+    boost::shared_ptr<crocoddyl::ActionDataAbstract> terminal_data;
+
+    std::vector<Eigen::VectorXd> xs;
+    std::vector<Eigen::VectorXd> us;
+    std::vector<Eigen::VectorXd> xs_try;
+    std::vector<Eigen::VectorXd> us_try;
+    double cost;
+    double cost_try;
+
+    // Sensitivity of every state to the stacked torques, one ndx block row per node.
+    Eigen::MatrixXd Su;
+    Eigen::MatrixXd Lxx_Su;
+    Eigen::MatrixXd Su_Lxu;
+
+    // Condensed QP
+    Eigen::MatrixXd H;
+    Eigen::VectorXd g;
+    Eigen::VectorXd du;
+    Eigen::VectorXd du_lb;
+    Eigen::VectorXd du_ub;
+
+    // Projected Newton buffers
+    int max_qp_iterations;
+    Eigen::MatrixXd H_free;
+    Eigen::LLT<Eigen::MatrixXd> llt;
+    Eigen::VectorXd qp_gradient;
+    Eigen::VectorXd du_clamped;
+    Eigen::VectorXd du_newton;
+    Eigen::VectorXd du_candidate;
+    Eigen::VectorXd H_du;
+    std::vector<bool> clamped;
+
+    double reg;
+    double reg_min;
+    double reg_max;
+    double th_stop;
+    double expected_improvement;
+    std::size_t iter;
+
+    long solves;
+    long qp_iterations;
+
+    double rollout(const std::vector<Eigen::VectorXd> &us_in, std::vector<Eigen::VectorXd> &xs_out);
+    void condense();
+    double qpValue(const Eigen::VectorXd &x);
+    bool solveQP();
+
+public:
+    SolverCondensedQP(const boost::shared_ptr<crocoddyl::ShootingProblem> &problem, int max_qp_iterations);
+
+    // Uses problem->get_x0() as initial state and init_us as the nominal sequence, the states
+    // follow from the rollout. Returns true when the expected improvement went below th_stop.
+    bool solve(const std::vector<Eigen::VectorXd> &init_us, std::size_t maxiter);
+
+    void set_th_stop(double th_stop);
+    // The solver has its own node datas, so a goal weight reload has to be written into them too.
+    void setGoalWeights(const Eigen::VectorXd &weights);
+
+    const std::vector<Eigen::VectorXd>& get_xs() const;
+    const std::vector<Eigen::VectorXd>& get_us() const;
+    double get_cost() const;
+    std::size_t get_iter() const;
+    double get_expected_improvement() const;
+    void print();
+};
+
+#endif
@@ -0,0 +1,205 @@
+#include "SolverEarlyStop.h"
+
+#include <iostream>
+
+SolverEarlyStop::SolverEarlyStop(boost::shared_ptr<crocoddyl::ShootingProblem> problem) : crocoddyl::SolverBoxFDDP(problem),
+    improvement_threshold(0), gap_tolerance(0), reuse_state_tolerance(0), max_gain_reuse(0), gains_valid(false),
+    consecutive_reuses(0), last_outcome(FULL_SOLVE), solves(0), forward_passes_skipped(0), gain_reuses(0), linearizations(0)
+{
+    const boost::shared_ptr<crocoddyl::ActionModelAbstract> &model = problem->get_runningModels()[0];
+    dx0 = Eigen::VectorXd::Zero(model->get_state()->get_ndx());
+    quu_k = Eigen::VectorXd::Zero(model->get_nu());
+}
+
+void SolverEarlyStop::setEarlyStop(double improvement_threshold, double gap_tolerance)
+{
+    this->improvement_threshold = improvement_threshold;
+    this->gap_tolerance = gap_tolerance;
+}
+
+void SolverEarlyStop::setGainReuse(double reuse_state_tolerance, int max_gain_reuse)
+{
+    this->reuse_state_tolerance = reuse_state_tolerance;
+    this->max_gain_reuse = max_gain_reuse;
+}
+
+void SolverEarlyStop::invalidateGains()
+{
+    gains_valid = false;
+}
+
+//Cost decrease the full Newton step of the last backward pass expects, Qu'k - k'Quu k / 2 summed over the nodes.
+double SolverEarlyStop::expectedNewtonImprovement()
+{
+    double improvement = 0;
+    for(std::size_t t = 0; t < problem_->get_T(); t++)
+    {
+        quu_k.noalias() = Quu_[t] * k_[t];
+        improvement += Qu_[t].dot(k_[t]) - 0.5 * k_[t].dot(quu_k);
+    }
+    return improvement;
+}
+
+//Largest dynamics gap after the first node, the first one is the new x0 and is closed by applyFirstNode.
+double SolverEarlyStop::maxGap()
+{
+    double gap = 0;
+    for(std::size_t t = 1; t < fs_.size(); t++)
+        gap = std::max(gap, fs_[t].lpNorm<Eigen::Infinity>());
+    return gap;
+}
+
+//The first step of the forward pass alone: the local policy of node 0 evaluated at x0.
+void SolverEarlyStop::applyFirstNode()
+{
+    const boost::shared_ptr<crocoddyl::ActionModelAbstract> &model = problem_->get_runningModels()[0];
+
+    model->get_state()->diff(xs_[0], problem_->get_x0(), dx0);
+    us_[0] -= k_[0];
+    us_[0].noalias() -= K_[0] * dx0;
+    us_[0] = us_[0].cwiseMax(model->get_u_lb()).cwiseMin(model->get_u_ub());
+    xs_[0] = problem_->get_x0();
+}
+
+//Rolls out the previous tick feedback gains, shifted one node like the warm start.
+bool SolverEarlyStop::reuseGains()
+{
+    const std::size_t T = problem_->get_T();
+    for(std::size_t t = 0; t + 1 < T; t++)
+        K_[t] = K_[t + 1];
+    for(std::size_t t = 0; t < T; t++)
+        k_[t].setZero();
+
+    try{
+        forwardPass(1.);
+    }catch(std::exception &e){
+        return false;
+    }
+
+    setCandidate(xs_try_, us_try_, true);
+    cost_ = cost_try_;
+    iter_ = 0;
+    return true;
+}
+
+bool SolverEarlyStop::solve(const std::vector<Eigen::VectorXd>& init_xs, const std::vector<Eigen::VectorXd>& init_us,
+                            const std::size_t maxiter, const bool is_feasible, const double reginit)
+{
+    solves++;
+
+    xs_try_[0] = problem_->get_x0();
+    setCandidate(init_xs, init_us, is_feasible);
+
+    if(max_gain_reuse > 0 && gains_valid && consecutive_reuses < max_gain_reuse)
+    {
+        problem_->get_runningModels()[0]->get_state()->diff(xs_[0], problem_->get_x0(), dx0);
+        if(dx0.lpNorm<Eigen::Infinity>() < reuse_state_tolerance && reuseGains())
+        {
+            consecutive_reuses++;
+            gain_reuses++;
+            last_outcome = GAINS_REUSED;
+            return true;
+        }
+        //The gains were shifted or the rollout failed, either way they are not this tick ones anymore.
+        setCandidate(init_xs, init_us, is_feasible);
+    }
+    consecutive_reuses = 0;
+    gains_valid = false;
+    last_outcome = FULL_SOLVE;
+
+    if(std::isnan(reginit)){
+        xreg_ = regmin_;
+        ureg_ = regmin_;
+    }else{
+        xreg_ = reginit;
+        ureg_ = reginit;
+    }
+    was_feasible_ = false;
+
+    //Same iterations as SolverFDDP::solve, with the early exit after every new linearization.
+    bool recalcDiff = true;
+    for(iter_ = 0; iter_ < maxiter; ++iter_)
+    {
+        const bool linearized = recalcDiff;
+        while(true)
+        {
+            try{
+                computeDirection(recalcDiff);
+            }catch(std::exception &e){
+                recalcDiff = false;
+                increaseRegularization();
+                if(xreg_ == regmax_) return false;
+                continue;
+            }
+            break;
+        }
+        if(linearized) linearizations++;
+        gains_valid = true;
+
+        if(improvement_threshold > 0 && linearized && expectedNewtonImprovement() < improvement_threshold && maxGap() < gap_tolerance)
+        {
+            applyFirstNode();
+            forward_passes_skipped++;
+            last_outcome = FORWARD_PASS_SKIPPED;
+            return true;
+        }
+
+        updateExpectedImprovement();
+
+        recalcDiff = false;
+        for(std::vector<double>::const_iterator it = alphas_.begin(); it != alphas_.end(); ++it)
+        {
+            steplength_ = *it;
+
+            try{
+                dV_ = tryStep(steplength_);
+            }catch(std::exception &e){
+                continue;
+            }
+            expectedImprovement();
+            dVexp_ = steplength_ * (d_[0] + 0.5 * steplength_ * d_[1]);
+
+            if(dVexp_ >= 0){
+                if(std::abs(d_[0]) < th_grad_ || dV_ > th_acceptstep_ * dVexp_){
+                    was_feasible_ = is_feasible_;
+                    setCandidate(xs_try_, us_try_, was_feasible_ || steplength_ == 1);
+                    cost_ = cost_try_;
+                    recalcDiff = true;
+                    break;
+                }
+            }else{
+                if(dV_ > th_acceptnegstep_ * dVexp_){
+                    was_feasible_ = is_feasible_;
+                    setCandidate(xs_try_, us_try_, was_feasible_ || steplength_ == 1);
+                    cost_ = cost_try_;
+                    recalcDiff = true;
+                    break;
+                }
+            }
+        }
+
+        if(steplength_ > th_stepdec_) decreaseRegularization();
+        if(steplength_ <= th_stepinc_){
+            increaseRegularization();
+            if(xreg_ == regmax_) return false;
+        }
+        stoppingCriteria();
+
+        for(auto const& callback: callbacks_)
+            (*callback)(*this);
+
+        if(was_feasible_ && stop_ < th_stop_) return true;
+    }
+    return false;
+}
+
+early_stop_outcome SolverEarlyStop::get_last_outcome() const
+{
+    return last_outcome;
+}
+
+void SolverEarlyStop::print()
+{
+    std::cout << "Early stop solver: " << solves << " solves, " << forward_passes_skipped << " forward passes skipped, "
+    << gain_reuses << " gain reuses, " << linearizations << " linearizations." << std::endl;
+}
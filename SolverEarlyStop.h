@@ -0,0 +1,65 @@
+#ifndef DoublePENDULUM_SOLVEREARLYSTOP_H
+#define DoublePENDULUM_SOLVEREARLYSTOP_H
+
+#include "crocoddyl/core/solvers/box-fddp.hpp"
+
+enum early_stop_outcome{
+    FULL_SOLVE = 0,
+    // The warm start was already optimal, only the first node was corrected.
+    FORWARD_PASS_SKIPPED = 1,
+    // The state matched the plan, the previous gains were rolled out without linearizing.
+    GAINS_REUSED = 2
+};
+
+// Box-FDDP for warm started MPC ticks. It runs the same iterations as SolverBoxFDDP, but
+// returns as soon as a fresh linearization expects less improvement than a threshold,
+// applying only the first node of the step instead of the whole forward pass. When x0
+// lands on the node the previous tick planned, it skips calcDiff and the backward pass
+// and rolls out the previous feedback gains shifted one node.
+class SolverEarlyStop : public crocoddyl::SolverBoxFDDP
+{
+private:
+    double improvement_threshold;
+    double gap_tolerance;
+    double reuse_state_tolerance;
+    int max_gain_reuse;
+
+    bool gains_valid;
+    int consecutive_reuses;
+    early_stop_outcome last_outcome;
+
+    Eigen::VectorXd dx0;
+    Eigen::VectorXd quu_k;
+
+    long solves;
+    long forward_passes_skipped;
+    long gain_reuses;
+    long linearizations;
+
+    double expectedNewtonImprovement();
+    double maxGap();
+    void applyFirstNode();
+    bool reuseGains();
+
+public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    explicit SolverEarlyStop(boost::shared_ptr<crocoddyl::ShootingProblem> problem);
+
+    // A threshold of 0 disables the early exit, a max_gain_reuse of 0 disables the gain reuse.
+    void setEarlyStop(double improvement_threshold, double gap_tolerance);
+    void setGainReuse(double reuse_state_tolerance, int max_gain_reuse);
+
+    // The cached gains belong to the old costs, call it after changing references or weights.
+    void invalidateGains();
+
+    bool solve(const std::vector<Eigen::VectorXd>& init_xs = crocoddyl::DEFAULT_VECTOR,
+               const std::vector<Eigen::VectorXd>& init_us = crocoddyl::DEFAULT_VECTOR,
+               const std::size_t maxiter = 100, const bool is_feasible = false,
+               const double reginit = 1e-9) override;
+
+    early_stop_outcome get_last_outcome() const;
+    void print();
+};
+
+#endif
@@ -0,0 +1,170 @@
+#include "SolverMPPI.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+namespace {
+
+// Small counter based generator. Every sample gets its own seed, so the result does
+// not depend on which worker ran which sample.
+struct NormalSampler
+{
+    uint64_t s;
+    bool has_spare;
+    double spare;
+
+    explicit NormalSampler(uint64_t seed) : s(seed), has_spare(false), spare(0) {}
+
+    uint64_t next()
+    {
+        //splitmix64
+        uint64_t z = (s += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    double uniform()
+    {
+        return ((next() >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+    }
+
+    double normal()
+    {
+        //Box-Muller
+        if(has_spare){
+            has_spare = false;
+            return spare;
+        }
+        double r = std::sqrt(-2.0 * std::log(uniform()));
+        double a = 2.0 * M_PI * uniform();
+        spare = r * std::sin(a);
+        has_spare = true;
+        return r * std::cos(a);
+    }
+};
+
+}
+
+template<typename Scalar>
+SolverMPPITpl<Scalar>::SolverMPPITpl(const boost::shared_ptr<ShootingProblem> &problem, int samples, Scalar noise_sigma,
+                                     Scalar temperature, int threads, const VectorXs &u_lb, const VectorXs &u_ub) :
+    problem(problem), samples(samples), noise_sigma(noise_sigma), temperature(temperature), u_lb(u_lb), u_ub(u_ub),
+    pool(threads), cost(0), solve_count(0)
+{
+    const auto &running_models = problem->get_runningModels();
+    const std::size_t T = problem->get_T();
+    const std::size_t nu = running_models[0]->get_nu();
+
+    worker_running_datas.resize(pool.size());
+    for(int w = 0; w < pool.size(); w++){
+        for(std::size_t t = 0; t < T; t++)
+            worker_running_datas[w].push_back(running_models[t]->createData());
+        worker_terminal_datas.push_back(problem->get_terminalModel()->createData());
+    }
+
+    sample_us.resize(samples, MatrixXs::Zero(nu, T));
+    sample_costs.resize(samples, 0);
+    sample_weights.resize(samples, 0);
+
+    xs.resize(T + 1, problem->get_x0());
+    us.resize(T, VectorXs::Zero(nu));
+
+    std::cout << "MPPI (" << 8 * sizeof(Scalar) << " bit) with " << samples << " samples on " << pool.size() << " threads." << std::endl;
+}
+
+template<typename Scalar>
+void SolverMPPITpl<Scalar>::sampleRollout(int sample, int worker)
+{
+    const auto &running_models = problem->get_runningModels();
+    const auto &datas = worker_running_datas[worker];
+    MatrixXs &u = sample_us[sample];
+
+    NormalSampler sampler(solve_count * 0x100000001B3ULL + sample);
+
+    Scalar sample_cost = 0;
+    const VectorXs *x = &problem->get_x0();
+
+    for(std::size_t t = 0; t < datas.size(); t++)
+    {
+        //Sample 0 keeps the nominal sequence so the average is never worse than the warm start.
+        if(sample != 0){
+            for(int i = 0; i < u.rows(); i++)
+                u(i, t) = us[t][i] + noise_sigma * Scalar(sampler.normal());
+        }else{
+            u.col(t) = us[t];
+        }
+        u.col(t) = u.col(t).cwiseMax(u_lb).cwiseMin(u_ub);
+
+        running_models[t]->calc(datas[t], *x, u.col(t));
+        sample_cost += datas[t]->cost;
+        x = &datas[t]->xnext;
+    }
+
+    problem->get_terminalModel()->calc(worker_terminal_datas[worker], *x);
+    sample_cost += worker_terminal_datas[worker]->cost;
+
+    sample_costs[sample] = std::isfinite(sample_cost) ? sample_cost : std::numeric_limits<Scalar>::max();
+}
+
+template<typename Scalar>
+void SolverMPPITpl<Scalar>::solve(const std::vector<VectorXs> &init_us, int iterations)
+{
+    for(std::size_t t = 0; t < us.size(); t++)
+        us[t] = init_us[t];
+
+    const std::function<void(int, int)> rollout = [this](int sample, int worker){ sampleRollout(sample, worker); };
+
+    for(int iter = 0; iter < iterations; iter++)
+    {
+        solve_count++;
+        pool.parallelFor(samples, rollout);
+
+        Scalar min_cost = *std::min_element(sample_costs.begin(), sample_costs.end());
+        Scalar weights_sum = 0;
+        for(int k = 0; k < samples; k++){
+            sample_weights[k] = std::exp(-(sample_costs[k] - min_cost) / temperature);
+            weights_sum += sample_weights[k];
+        }
+
+        for(std::size_t t = 0; t < us.size(); t++)
+        {
+            us[t].setZero();
+            for(int k = 0; k < samples; k++)
+                us[t].noalias() += (sample_weights[k] / weights_sum) * sample_us[k].col(t);
+        }
+    }
+
+    problem->rollout(us, xs);
+    cost = problem->calc(xs, us);
+}
+
+template<typename Scalar>
+void SolverMPPITpl<Scalar>::set_bounds(const VectorXs &u_lb, const VectorXs &u_ub)
+{
+    this->u_lb = u_lb;
+    this->u_ub = u_ub;
+}
+
+template<typename Scalar>
+const std::vector<typename SolverMPPITpl<Scalar>::VectorXs>& SolverMPPITpl<Scalar>::get_xs() const
+{
+    return xs;
+}
+
+template<typename Scalar>
+const std::vector<typename SolverMPPITpl<Scalar>::VectorXs>& SolverMPPITpl<Scalar>::get_us() const
+{
+    return us;
+}
+
+template<typename Scalar>
+Scalar SolverMPPITpl<Scalar>::get_cost() const
+{
+    return cost;
+}
+
+template class SolverMPPITpl<double>;
+template class SolverMPPITpl<float>;
@@ -0,0 +1,69 @@
+#ifndef DoublePENDULUM_SOLVERMPPI_H
+#define DoublePENDULUM_SOLVERMPPI_H
+
+#include "crocoddyl/core/fwd.hpp"
+#include "crocoddyl/core/optctrl/shooting.hpp"
+
+#include "ThreadPool.h"
+
+// Model Predictive Path Integral control. Samples noisy torque sequences around
+// a nominal one, rolls them out through the same action models (and so the same
+// costs and weights) as the FDDP problem and keeps the cost weighted average.
+// Templated on the scalar so the online loop can run on a float copy of the problem.
+template<typename _Scalar>
+class SolverMPPITpl
+{
+public:
+    typedef _Scalar Scalar;
+    typedef crocoddyl::MathBaseTpl<Scalar> MathBase;
+    typedef typename MathBase::VectorXs VectorXs;
+    typedef typename MathBase::MatrixXs MatrixXs;
+    typedef crocoddyl::ShootingProblemTpl<Scalar> ShootingProblem;
+    typedef crocoddyl::ActionDataAbstractTpl<Scalar> ActionDataAbstract;
+
+private:
+    boost::shared_ptr<ShootingProblem> problem;
+
+    int samples;
+    Scalar noise_sigma;
+    Scalar temperature;
+
+    VectorXs u_lb;
+    VectorXs u_ub;
+
+    ThreadPool pool;
+
+    // Every worker rolls out on its own datas, the problem ones are used for the final rollout.
+    std::vector<std::vector<boost::shared_ptr<ActionDataAbstract>>> worker_running_datas;
+    std::vector<boost::shared_ptr<ActionDataAbstract>> worker_terminal_datas;
+
+    // Sampled controls, one (nu x T) matrix for each sample.
+    std::vector<MatrixXs> sample_us;
+    std::vector<Scalar> sample_costs;
+    std::vector<Scalar> sample_weights;
+
+    std::vector<VectorXs> xs;
+    std::vector<VectorXs> us;
+    Scalar cost;
+
+    unsigned long solve_count;
+
+    void sampleRollout(int sample, int worker);
+
+public:
+    SolverMPPITpl(const boost::shared_ptr<ShootingProblem> &problem, int samples, Scalar noise_sigma,
+                  Scalar temperature, int threads, const VectorXs &u_lb, const VectorXs &u_ub);
+
+    // Uses problem->get_x0() as initial state and init_us as the nominal sequence.
+    void solve(const std::vector<VectorXs> &init_us, int iterations);
+
+    void set_bounds(const VectorXs &u_lb, const VectorXs &u_ub);
+
+    const std::vector<VectorXs>& get_xs() const;
+    const std::vector<VectorXs>& get_us() const;
+    Scalar get_cost() const;
+};
+
+typedef SolverMPPITpl<double> SolverMPPI;
+
+#endif
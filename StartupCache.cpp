@@ -0,0 +1,167 @@
+#include "StartupCache.h"
+
+#include "pinocchio/serialization/model.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+static const char CACHE_MAGIC[4] = {'D', 'P', 'S', 'C'};
+static const uint32_t CACHE_VERSION = 1;
+
+StartupCache::StartupCache(const std::string &path, const std::string &urdf_path, const std::string &config_path) :
+    path(path), urdf_hash(hashFile(urdf_path)), config_hash(hashFile(config_path)), valid(false), has_model(false)
+{
+    valid = read(path);
+    std::cout << "Startup cache " << path << (valid ? " is valid." : " is missing or stale.") << std::endl;
+}
+
+//64 bit FNV-1a of the whole file, 0 when it can not be read.
+uint64_t StartupCache::hashFile(const std::string &path)
+{
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if(!file) return 0;
+
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    unsigned char buffer[4096];
+    std::size_t size;
+    while((size = std::fread(buffer, 1, sizeof(buffer), file)) > 0){
+        for(std::size_t i = 0; i < size; i++){
+            hash ^= buffer[i];
+            hash *= 0x100000001b3ULL;
+        }
+    }
+    std::fclose(file);
+    return hash;
+}
+
+static bool readVector(FILE *file, Eigen::VectorXd &v, int32_t size)
+{
+    v.resize(size);
+    return std::fread(v.data(), sizeof(double), size, file) == (std::size_t)size;
+}
+
+bool StartupCache::read(const std::string &path)
+{
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if(!file) return false;
+
+    char magic[4];
+    uint32_t version;
+    uint64_t hashes[2];
+    int32_t dims[4];
+
+    bool ok = std::fread(magic, 1, sizeof(magic), file) == sizeof(magic) && std::equal(magic, magic + 4, CACHE_MAGIC)
+        && std::fread(&version, sizeof(version), 1, file) == 1 && version == CACHE_VERSION
+        && std::fread(hashes, sizeof(hashes), 1, file) == 1 && hashes[0] == urdf_hash && hashes[1] == config_hash
+        && std::fread(&parameters, sizeof(parameters), 1, file) == 1
+        && std::fread(dims, sizeof(dims), 1, file) == 1 && dims[0] > 0 && dims[1] >= 0 && dims[2] >= 0 && dims[3] >= 0
+        && readVector(file, initial_state, dims[0]);
+
+    if(ok){
+        trajectory_xs.resize(dims[2]);
+        trajectory_us.resize(dims[3]);
+        for(auto &x: trajectory_xs) ok = ok && readVector(file, x, dims[0]);
+        for(auto &u: trajectory_us) ok = ok && readVector(file, u, dims[1]);
+    }
+
+    std::fclose(file);
+    return ok && urdf_hash != 0 && config_hash != 0;
+}
+
+bool StartupCache::isValid() const
+{
+    return valid;
+}
+
+bool StartupCache::loadModel(pinocchio::Model &model) const
+{
+    if(!valid) return false;
+    try{
+        model.loadFromBinary(path + ".model");
+    }catch(std::exception &e){
+        std::cout << "Could not load the cached model: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void StartupCache::setModel(const pinocchio::Model &model)
+{
+    this->model = model;
+    has_model = true;
+}
+
+//Both files are written next to the old ones and renamed over them, so a crash never leaves half
+//a file. The model goes first: a crash in between leaves the old snapshot, which only matches
+//the new model file when they come from the same URDF.
+void StartupCache::save(const TunableParameters &parameters, const Eigen::VectorXd &initial_state,
+                        const std::vector<Eigen::VectorXd> &trajectory_xs, const std::vector<Eigen::VectorXd> &trajectory_us)
+{
+    if(has_model){
+        const std::string model_path = path + ".model";
+        try{
+            model.saveToBinary(model_path + ".tmp");
+        }catch(std::exception &e){
+            std::cout << "Could not cache the model: " << e.what() << std::endl;
+            return;
+        }
+        if(std::rename((model_path + ".tmp").c_str(), model_path.c_str()) != 0){
+            std::cout << "Could not write the cached model " << model_path << std::endl;
+            return;
+        }
+        has_model = false;
+    }
+
+    const std::string tmp_path = path + ".tmp";
+    FILE *file = std::fopen(tmp_path.c_str(), "wb");
+    if(!file){
+        std::cout << "Could not open " << tmp_path << " to write the startup cache." << std::endl;
+        return;
+    }
+
+    const uint64_t hashes[2] = {urdf_hash, config_hash};
+    const int32_t dims[4] = {(int32_t)initial_state.size(), trajectory_us.empty() ? 0 : (int32_t)trajectory_us[0].size(),
+                             (int32_t)trajectory_xs.size(), (int32_t)trajectory_us.size()};
+
+    std::fwrite(CACHE_MAGIC, 1, sizeof(CACHE_MAGIC), file);
+    std::fwrite(&CACHE_VERSION, sizeof(CACHE_VERSION), 1, file);
+    std::fwrite(hashes, sizeof(hashes), 1, file);
+    std::fwrite(&parameters, sizeof(parameters), 1, file);
+    std::fwrite(dims, sizeof(dims), 1, file);
+    std::fwrite(initial_state.data(), sizeof(double), initial_state.size(), file);
+    for(auto const& x: trajectory_xs) std::fwrite(x.data(), sizeof(double), x.size(), file);
+    for(auto const& u: trajectory_us) std::fwrite(u.data(), sizeof(double), u.size(), file);
+
+    const bool written = std::fclose(file) == 0;
+    if(!written || std::rename(tmp_path.c_str(), path.c_str()) != 0){
+        std::cout << "Could not write the startup cache " << path << std::endl;
+        return;
+    }
+
+    this->parameters = parameters;
+    this->initial_state = initial_state;
+    this->trajectory_xs = trajectory_xs;
+    this->trajectory_us = trajectory_us;
+    valid = true;
+}
+
+const TunableParameters& StartupCache::get_parameters() const
+{
+    return parameters;
+}
+
+const Eigen::VectorXd& StartupCache::get_initial_state() const
+{
+    return initial_state;
+}
+
+const std::vector<Eigen::VectorXd>& StartupCache::get_trajectory_xs() const
+{
+    return trajectory_xs;
+}
+
+const std::vector<Eigen::VectorXd>& StartupCache::get_trajectory_us() const
+{
+    return trajectory_us;
+}
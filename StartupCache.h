@@ -0,0 +1,59 @@
+#ifndef DoublePENDULUM_STARTUPCACHE_H
+#define DoublePENDULUM_STARTUPCACHE_H
+
+#include "pinocchio/multibody/model.hpp"
+
+#include "ConfigWatcher.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Snapshot of what a launch builds before the first torque: the pinocchio model, the weights
+// and the last converged swing up trajectory. It is keyed by FNV-1a hashes of the URDF and the
+// config files, so editing either one invalidates it. The model goes to path + ".model" with
+// the pinocchio binary serialization, the rest to path. Both are only written by save, so the
+// model file is never newer than the hashes that vouch for it.
+class StartupCache
+{
+private:
+    std::string path;
+    uint64_t urdf_hash;
+    uint64_t config_hash;
+    bool valid;
+
+    // Built from the URDF in this launch and not written yet.
+    pinocchio::Model model;
+    bool has_model;
+
+    TunableParameters parameters;
+    Eigen::VectorXd initial_state;
+    std::vector<Eigen::VectorXd> trajectory_xs;
+    std::vector<Eigen::VectorXd> trajectory_us;
+
+    bool read(const std::string &path);
+
+public:
+    // Reads the snapshot at path, it is only valid when both hashes match.
+    StartupCache(const std::string &path, const std::string &urdf_path, const std::string &config_path);
+
+    static uint64_t hashFile(const std::string &path);
+
+    bool isValid() const;
+
+    // False when the snapshot is not valid or the model file can not be read.
+    bool loadModel(pinocchio::Model &model) const;
+    // Keeps the model built from the URDF to write it with the next save.
+    void setModel(const pinocchio::Model &model);
+
+    // Writes the model given to setModel, if any, and then the snapshot.
+    void save(const TunableParameters &parameters, const Eigen::VectorXd &initial_state,
+              const std::vector<Eigen::VectorXd> &trajectory_xs, const std::vector<Eigen::VectorXd> &trajectory_us);
+
+    const TunableParameters& get_parameters() const;
+    const Eigen::VectorXd& get_initial_state() const;
+    const std::vector<Eigen::VectorXd>& get_trajectory_xs() const;
+    const std::vector<Eigen::VectorXd>& get_trajectory_us() const;
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include "StateEstimator.h"
+
+StateEstimator::StateEstimator(const boost::shared_ptr<crocoddyl::StateMultibody> &state,
+                               const boost::shared_ptr<crocoddyl::ActuationModelAbstract> &actuation,
+                               const Eigen::VectorXd &process_noise, const Eigen::VectorXd &measurement_noise, double max_step) :
+    nq(state->get_nq()), nv(state->get_nv()), max_step(max_step), t(0), initialized(false), pending_t(0), has_pending(false)
+{
+    //Same dynamics and actuation as the MPC, without costs.
+    auto costs = boost::make_shared<crocoddyl::CostModelSum>(state, actuation->get_nu());
+    dynamics = boost::make_shared<crocoddyl::DifferentialActionModelFreeFwdDynamics>(state, actuation, costs);
+    dynamics_data = dynamics->createData();
+
+    const int nx = state->get_nx();
+    x = state->zero();
+    P = Eigen::MatrixXd::Identity(nx, nx);
+    Q = process_noise.cwiseAbs2().asDiagonal();
+    R = measurement_noise.cwiseAbs2().asDiagonal();
+
+    u = Eigen::VectorXd::Zero(actuation->get_nu());
+    pending_u = u;
+
+    F = Eigen::MatrixXd::Identity(nx, nx);
+    K = Eigen::MatrixXd::Zero(nx, nx);
+    S = Eigen::MatrixXd::Zero(nx, nx);
+    S_llt = Eigen::LLT<Eigen::MatrixXd>(nx);
+    FP = Eigen::MatrixXd::Zero(nx, nx);
+    innovation = Eigen::VectorXd::Zero(nx);
+    x_prediction = x;
+}
+
+void StateEstimator::integrate(Eigen::VectorXd &x, const Eigen::VectorXd &u, double dt, bool covariance)
+{
+    dynamics->calc(dynamics_data, x, u);
+
+    if(covariance){
+        //Jacobian of the semi-implicit step below: the velocity rows are I + dt * da/dx and the
+        //positions move with the new velocity, so their rows are [I 0] + dt * velocity rows.
+        dynamics->calcDiff(dynamics_data, x, u);
+        F.setIdentity();
+        F.bottomRows(nv).noalias() += dt * dynamics_data->Fx;
+        F.topRows(nq) += dt * F.bottomRows(nv);
+        FP.noalias() = F * P;
+        P.noalias() = FP * F.transpose();
+        P += dt * Q;
+    }
+
+    //Semi-implicit Euler, like the integrated action models.
+    x.tail(nv) += dt * dynamics_data->xout;
+    x.head(nq) += dt * x.tail(nv);
+}
+
+void StateEstimator::propagate(Eigen::VectorXd &x, double from, double to, bool covariance)
+{
+    double remaining = to - from;
+    const Eigen::VectorXd *current_u = &u;
+
+    //The pending torque only starts acting at pending_t.
+    if(has_pending && pending_t < to){
+        double before_switch = std::max(pending_t - from, 0.0);
+        while(before_switch > 1e-9){
+            double step = std::min(before_switch, max_step);
+            integrate(x, u, step, covariance);
+            before_switch -= step;
+            remaining -= step;
+        }
+        current_u = &pending_u;
+    }
+
+    while(remaining > 1e-9){
+        double step = std::min(remaining, max_step);
+        integrate(x, *current_u, step, covariance);
+        remaining -= step;
+    }
+}
+
+void StateEstimator::setAppliedControl(double t_applied, const Eigen::VectorXd &u_applied)
+{
+    //A torque still pending becomes the current one.
+    if(has_pending) u = pending_u;
+
+    pending_u = u_applied;
+    pending_t = t_applied;
+    has_pending = true;
+}
+
+void StateEstimator::update(double t_measurement, const Eigen::VectorXd &z)
+{
+    if(!initialized){
+        x = z;
+        t = t_measurement;
+        initialized = true;
+        return;
+    }
+
+    if(t_measurement > t){
+        propagate(x, t, t_measurement, true);
+
+        if(has_pending && pending_t <= t_measurement){
+            u = pending_u;
+            has_pending = false;
+        }
+        t = t_measurement;
+    }
+
+    //Position and velocity are both measured: H = I.
+    //K = P S^-1, with P and S symmetric it is (S^-1 P)^T.
+    S = P + R;
+    S_llt.compute(S);
+    K = P;
+    S_llt.solveInPlace(K);
+    K.transposeInPlace();
+    innovation = z - x;
+    x.noalias() += K * innovation;
+    FP.noalias() = K * P;
+    P -= FP;
+}
+
+void StateEstimator::predict(double t_target, Eigen::VectorXd &x_predicted)
+{
+    x_prediction = x;
+    if(t_target > t) propagate(x_prediction, t, t_target, false);
+    x_predicted = x_prediction;
+}
+
+const Eigen::VectorXd& StateEstimator::get_state() const
+{
+    return x;
+}
@@ -0,0 +1,64 @@
+#ifndef DoublePENDULUM_STATEESTIMATOR_H
+#define DoublePENDULUM_STATEESTIMATOR_H
+
+#include "crocoddyl/core/fwd.hpp"
+#include "crocoddyl/multibody/fwd.hpp"
+#include "crocoddyl/multibody/costs/cost-sum.hpp"
+#include "crocoddyl/multibody/actions/free-fwddyn.hpp"
+
+// Extended Kalman filter on the pendulum dynamics. Fuses the timestamped encoder
+// positions and velocities and predicts the state forward to the time the next torque
+// will reach the motors, using the torques that were really applied meanwhile.
+class StateEstimator
+{
+private:
+    boost::shared_ptr<crocoddyl::DifferentialActionModelFreeFwdDynamics> dynamics;
+    boost::shared_ptr<crocoddyl::DifferentialActionDataAbstract> dynamics_data;
+
+    int nq;
+    int nv;
+    double max_step;
+
+    Eigen::VectorXd x;
+    Eigen::MatrixXd P;
+    Eigen::MatrixXd Q;
+    Eigen::MatrixXd R;
+    double t;
+    bool initialized;
+
+    // Torque acting now and the one that starts acting at pending_t.
+    Eigen::VectorXd u;
+    Eigen::VectorXd pending_u;
+    double pending_t;
+    bool has_pending;
+
+    // Scratch
+    Eigen::MatrixXd F;
+    Eigen::MatrixXd K;
+    Eigen::MatrixXd S;
+    Eigen::LLT<Eigen::MatrixXd> S_llt;
+    Eigen::MatrixXd FP;
+    Eigen::VectorXd innovation;
+    Eigen::VectorXd x_prediction;
+
+    void integrate(Eigen::VectorXd &x, const Eigen::VectorXd &u, double dt, bool covariance);
+    void propagate(Eigen::VectorXd &x, double from, double to, bool covariance);
+
+public:
+    StateEstimator(const boost::shared_ptr<crocoddyl::StateMultibody> &state,
+                   const boost::shared_ptr<crocoddyl::ActuationModelAbstract> &actuation,
+                   const Eigen::VectorXd &process_noise, const Eigen::VectorXd &measurement_noise, double max_step);
+
+    // Torque sent to the motors at time t_applied.
+    void setAppliedControl(double t_applied, const Eigen::VectorXd &u);
+
+    // Propagates the filter to the measurement time and corrects it.
+    void update(double t_measurement, const Eigen::VectorXd &z);
+
+    // State expected at t_target, the filter itself is not modified.
+    void predict(double t_target, Eigen::VectorXd &x_predicted);
+
+    const Eigen::VectorXd& get_state() const;
+};
+
+#endif
@@ -0,0 +1,123 @@
+#include "SupervisorInterface.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+static const char SUPERVISOR_MAGIC[4] = {'D', 'P', 'S', 'V'};
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "The seqlocks need lock free atomics to work across processes.");
+
+SupervisorInterface::SupervisorInterface(const std::string &name) : name(name), region(nullptr), seen_command(0)
+{
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0660);
+    if(fd < 0 || ftruncate(fd, sizeof(SupervisorRegion)) < 0){
+        std::cout << "Could not create the supervisor region " << name << ": " << std::strerror(errno) << std::endl;
+        if(fd >= 0) close(fd);
+        return;
+    }
+
+    void *memory = mmap(nullptr, sizeof(SupervisorRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(memory == MAP_FAILED){
+        std::cout << "Could not map the supervisor region " << name << ": " << std::strerror(errno) << std::endl;
+        return;
+    }
+
+    //Start from a clean region, a supervisor left from a previous run sees the new layout.
+    std::memset(memory, 0, sizeof(SupervisorRegion));
+    region = new(memory) SupervisorRegion;
+    region->command.sequence.store(0, std::memory_order_relaxed);
+    region->status.sequence.store(0, std::memory_order_relaxed);
+    region->layout_version = SUPERVISOR_LAYOUT_VERSION;
+    region->region_size = sizeof(SupervisorRegion);
+    region->nx = 4;
+    region->nu = 2;
+
+    //Mapped pages are touched now and locked, so the first ticks do not page fault.
+    mlock(memory, sizeof(SupervisorRegion));
+
+    //The magic goes last, supervisors wait for it before using the region.
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(region->magic, SUPERVISOR_MAGIC, sizeof(region->magic));
+
+    std::cout << "Supervisor region " << name << " ready, " << sizeof(SupervisorRegion) << " bytes." << std::endl;
+}
+
+SupervisorInterface::~SupervisorInterface()
+{
+    if(region){
+        munmap(region, sizeof(SupervisorRegion));
+        shm_unlink(name.c_str());
+    }
+}
+
+bool SupervisorInterface::isOpen() const
+{
+    return region != nullptr;
+}
+
+bool SupervisorInterface::poll(SupervisorCommand &command)
+{
+    if(!region) return false;
+
+    SupervisorRegion::Command &shared = region->command;
+    const uint64_t sequence = shared.sequence.load(std::memory_order_acquire);
+
+    //Nothing new, or the supervisor is writing it right now. Try again next tick.
+    if(sequence == seen_command || (sequence & 1)) return false;
+
+    int32_t mode = shared.mode;
+    int32_t has_goal = shared.has_goal;
+    double goal[4];
+    std::memcpy(goal, shared.goal, sizeof(goal));
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(shared.sequence.load(std::memory_order_relaxed) != sequence) return false;
+
+    seen_command = sequence;
+    command.mode = mode;
+    command.has_goal = has_goal != 0;
+    command.goal = Eigen::Map<Eigen::Vector4d>(goal);
+    return true;
+}
+
+void SupervisorInterface::publish(uint64_t tick, double t, const Eigen::VectorXd &measured_state, const Eigen::VectorXd &x0,
+                                  const Eigen::VectorXd &torque, double cost, double solve_time, int iterations, int source, int mode,
+                                  const std::vector<Eigen::VectorXd> &plan_xs, const std::vector<Eigen::VectorXd> &plan_us)
+{
+    if(!region) return;
+
+    SupervisorRegion::Status &shared = region->status;
+    const uint64_t sequence = shared.sequence.load(std::memory_order_relaxed);
+
+    shared.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    shared.tick = tick;
+    shared.t = t;
+    Eigen::Map<Eigen::Vector4d>(shared.measured_state) = measured_state;
+    Eigen::Map<Eigen::Vector4d>(shared.x0) = x0;
+    Eigen::Map<Eigen::Vector2d>(shared.torque) = torque;
+    shared.cost = cost;
+    shared.solve_time = solve_time;
+    shared.iterations = iterations;
+    shared.source = source;
+    shared.mode = mode;
+
+    const int nodes = std::min<int>(plan_xs.size(), SUPERVISOR_MAX_NODES);
+    shared.plan_nodes = nodes;
+    for(int i = 0; i < nodes; i++){
+        Eigen::Map<Eigen::Vector4d>(shared.plan_xs[i]) = plan_xs[i];
+        if(i < (int)plan_us.size()) Eigen::Map<Eigen::Vector2d>(shared.plan_us[i]) = plan_us[i];
+    }
+
+    shared.sequence.store(sequence + 2, std::memory_order_release);
+}
@@ -0,0 +1,97 @@
+#ifndef DoublePENDULUM_SUPERVISORINTERFACE_H
+#define DoublePENDULUM_SUPERVISORINTERFACE_H
+
+#include <Eigen/Dense>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define SUPERVISOR_LAYOUT_VERSION 2
+#define SUPERVISOR_MAX_NODES 128
+
+enum supervisor_mode{
+    SUPERVISOR_NO_REQUEST = 0,
+    // Go back to the generated trajectory goal and its warm start.
+    SUPERVISOR_SWING_UP = 1,
+    // Hold the upright position from wherever the pendulum is.
+    SUPERVISOR_BALANCE = 2,
+    // Stop the control loop and disable the motors.
+    SUPERVISOR_STOP = 3
+};
+
+// Layout of the shared memory region. Each block is a seqlock: its writer makes the
+// sequence odd, writes the fields and makes it even again. Readers copy the fields
+// and retry later if the sequence was odd or changed meanwhile.
+struct SupervisorRegion
+{
+    char magic[4];
+    uint32_t layout_version;
+    uint32_t region_size;
+    uint32_t nx;
+    uint32_t nu;
+
+    // Written by the supervisor. Every new command must bump the sequence, a goal is
+    // only applied when has_goal is set.
+    struct Command
+    {
+        std::atomic<uint64_t> sequence;
+        int32_t mode;
+        int32_t has_goal;
+        double goal[4];
+    } command;
+
+    // Written by the controller every tick. The plan holds the last solution shifted one
+    // node, which is what the next tick starts from. plan_nodes counts the state nodes,
+    // the controls are the first plan_nodes - 1 rows of plan_us.
+    struct Status
+    {
+        std::atomic<uint64_t> sequence;
+        uint64_t tick;
+        double t;
+        double measured_state[4];
+        double x0[4];
+        double torque[2];
+        double cost;
+        double solve_time;
+        int32_t iterations;
+        int32_t source;
+        int32_t mode;
+        int32_t plan_nodes;
+        double plan_xs[SUPERVISOR_MAX_NODES][4];
+        double plan_us[SUPERVISOR_MAX_NODES][2];
+    } status;
+};
+
+struct SupervisorCommand
+{
+    int mode;
+    bool has_goal;
+    Eigen::Matrix<double, 4, 1, Eigen::DontAlign> goal;
+};
+
+// Owner side of the region, created with shm_open so any process can map it by name.
+// Polling and publishing are plain loads, stores and copies, the hot path makes no syscalls.
+class SupervisorInterface
+{
+private:
+    std::string name;
+    SupervisorRegion *region;
+    uint64_t seen_command;
+
+public:
+    explicit SupervisorInterface(const std::string &name);
+    ~SupervisorInterface();
+
+    bool isOpen() const;
+
+    // Returns true with the command when the supervisor wrote a new one since the last call.
+    bool poll(SupervisorCommand &command);
+
+    void publish(uint64_t tick, double t, const Eigen::VectorXd &measured_state, const Eigen::VectorXd &x0,
+                 const Eigen::VectorXd &torque, double cost, double solve_time, int iterations, int source, int mode,
+                 const std::vector<Eigen::VectorXd> &plan_xs, const std::vector<Eigen::VectorXd> &plan_us);
+};
+
+#endif
@@ -0,0 +1,167 @@
+#include "TelemetryPublisher.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+static const char TELEMETRY_MAGIC[4] = {'D', 'P', 'T', 'M'};
+static const uint32_t TELEMETRY_VERSION = 2;
+
+TelemetryPublisher::TelemetryPublisher(const std::string &path, int capacity, int batch_size, double batch_period) :
+    path(path), listen_fd(-1), ring(capacity), head(0), tail(0), batch_size(batch_size), batch_period(batch_period),
+    batch(sizeof(TelemetryBatchHeader) + batch_size * sizeof(TelemetryFrame)), stopping(false),
+    sent_frames(0), dropped_frames(0), dropped_batches(0)
+{
+    for(auto &slot: ring)
+        slot.sequence.store(0, std::memory_order_relaxed);
+
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(address.sun_path)){
+        std::cout << "Telemetry socket path too long: " << path << std::endl;
+        return;
+    }
+    std::strcpy(address.sun_path, path.c_str());
+
+    //A socket left by a previous run would make bind fail.
+    unlink(path.c_str());
+
+    listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(listen_fd < 0 || bind(listen_fd, (sockaddr *)&address, sizeof(address)) < 0 || listen(listen_fd, 4) < 0){
+        std::cout << "Could not open the telemetry socket " << path << ": " << std::strerror(errno) << std::endl;
+        if(listen_fd >= 0) close(listen_fd);
+        listen_fd = -1;
+        return;
+    }
+
+    publish_thread = std::thread(&TelemetryPublisher::publishLoop, this);
+    std::cout << "Publishing telemetry on " << path << std::endl;
+}
+
+TelemetryPublisher::~TelemetryPublisher()
+{
+    stopping = true;
+    if(publish_thread.joinable()) publish_thread.join();
+
+    for(int fd: clients) close(fd);
+    if(listen_fd >= 0){
+        close(listen_fd);
+        unlink(path.c_str());
+    }
+}
+
+void TelemetryPublisher::publish(const TelemetryFrame &frame)
+{
+    //Single producer, so the head only moves here.
+    uint64_t index = head.load(std::memory_order_relaxed);
+    Slot &slot = ring[index % ring.size()];
+
+    slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.frame = frame;
+    slot.sequence.store(2 * index + 2, std::memory_order_release);
+
+    head.store(index + 1, std::memory_order_release);
+}
+
+void TelemetryPublisher::publishLoop()
+{
+    const auto period = std::chrono::duration<double>(batch_period);
+
+    while(!stopping)
+    {
+        std::this_thread::sleep_for(period);
+        acceptClients();
+
+        if(clients.empty()){
+            //Nobody is watching, nothing to drop.
+            tail = head.load(std::memory_order_acquire);
+            continue;
+        }
+
+        int frame_count;
+        while((frame_count = collectBatch()) > 0)
+            sendBatch(frame_count);
+    }
+}
+
+void TelemetryPublisher::acceptClients()
+{
+    int fd;
+    while((fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+        clients.push_back(fd);
+}
+
+//Copies up to batch_size pending frames after the batch header. Frames the control thread
+//overwrote before they were read are counted as dropped.
+int TelemetryPublisher::collectBatch()
+{
+    const uint64_t capacity = ring.size();
+    const uint64_t available = head.load(std::memory_order_acquire);
+
+    if(available - tail > capacity){
+        dropped_frames += available - tail - capacity;
+        tail = available - capacity;
+    }
+
+    TelemetryFrame *frames = reinterpret_cast<TelemetryFrame *>(batch.data() + sizeof(TelemetryBatchHeader));
+    int frame_count = 0;
+
+    while(tail < available && frame_count < batch_size)
+    {
+        Slot &slot = ring[tail % capacity];
+        const uint64_t expected = 2 * tail + 2;
+
+        if(slot.sequence.load(std::memory_order_acquire) == expected)
+        {
+            std::memcpy(&frames[frame_count], &slot.frame, sizeof(TelemetryFrame));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(slot.sequence.load(std::memory_order_relaxed) == expected) frame_count++;
+            else dropped_frames++;
+        }else{
+            dropped_frames++;
+        }
+        tail++;
+    }
+    return frame_count;
+}
+
+void TelemetryPublisher::sendBatch(int frame_count)
+{
+    TelemetryBatchHeader *header = reinterpret_cast<TelemetryBatchHeader *>(batch.data());
+    std::memcpy(header->magic, TELEMETRY_MAGIC, sizeof(header->magic));
+    header->version = TELEMETRY_VERSION;
+    header->frame_count = frame_count;
+    header->frame_size = sizeof(TelemetryFrame);
+    header->dropped_frames = dropped_frames;
+
+    const std::size_t size = sizeof(TelemetryBatchHeader) + frame_count * sizeof(TelemetryFrame);
+
+    for(std::size_t i = 0; i < clients.size(); )
+    {
+        if(send(clients[i], batch.data(), size, MSG_DONTWAIT | MSG_NOSIGNAL) >= 0){
+            i++;
+        }else if(errno == EAGAIN || errno == EWOULDBLOCK){
+            //A slow client loses this batch, the next ones still go out.
+            dropped_batches++;
+            i++;
+        }else{
+            close(clients[i]);
+            clients.erase(clients.begin() + i);
+        }
+    }
+    sent_frames += frame_count;
+}
+
+void TelemetryPublisher::printStats()
+{
+    std::cout << "Telemetry: " << sent_frames << " frames sent, " << dropped_frames << " frames and "
+    << dropped_batches << " batches dropped." << std::endl;
+}
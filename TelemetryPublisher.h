@@ -0,0 +1,87 @@
+#ifndef DoublePENDULUM_TELEMETRYPUBLISHER_H
+#define DoublePENDULUM_TELEMETRYPUBLISHER_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One control tick. The layout is fixed, a dashboard can read it as a packed C struct.
+// Angles and velocities are ordered as the controller state: q_m0, q_m1, v_m0, v_m1.
+#pragma pack(push, 1)
+struct TelemetryFrame
+{
+    uint64_t tick;
+    double t;
+    double measured_state[4];
+    double x0[4];
+    double torque[2];
+    double cost;
+    double solve_time;
+    int32_t iterations;
+    int32_t source;
+    int32_t solve_outcome; // early_stop_outcome, FULL_SOLVE unless the MPC skipped work
+};
+
+// Every message on the socket is a header followed by frame_count frames.
+struct TelemetryBatchHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t frame_count;
+    uint32_t frame_size;
+    uint64_t dropped_frames;
+};
+#pragma pack(pop)
+
+// Streams the control ticks to local dashboards over a SOCK_SEQPACKET Unix socket.
+// The control thread only copies the frame into a ring, a publisher thread sends the
+// pending frames in batches. When the ring is full the oldest frames are overwritten,
+// and a client that does not keep up loses whole batches, so nothing ever waits on them.
+class TelemetryPublisher
+{
+private:
+    // Seqlock slot: the sequence is odd while the frame is being written.
+    struct Slot
+    {
+        std::atomic<uint64_t> sequence;
+        TelemetryFrame frame;
+    };
+
+    std::string path;
+    int listen_fd;
+    std::vector<int> clients;
+
+    std::vector<Slot> ring;
+    std::atomic<uint64_t> head;
+    uint64_t tail;
+
+    int batch_size;
+    double batch_period;
+    std::vector<char> batch;
+
+    std::thread publish_thread;
+    std::atomic<bool> stopping;
+
+    std::atomic<uint64_t> sent_frames;
+    std::atomic<uint64_t> dropped_frames;
+    std::atomic<uint64_t> dropped_batches;
+
+    void publishLoop();
+    void acceptClients();
+    int collectBatch();
+    void sendBatch(int frame_count);
+
+public:
+    // capacity frames are kept while the publisher is behind, batch_period is in seconds.
+    TelemetryPublisher(const std::string &path, int capacity, int batch_size, double batch_period);
+    ~TelemetryPublisher();
+
+    // Called from the control thread. Wait free, no syscalls.
+    void publish(const TelemetryFrame &frame);
+
+    void printStats();
+};
+
+#endif
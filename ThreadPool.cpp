@@ -0,0 +1,81 @@
+#include "ThreadPool.h"
+#include "AllocationTracker.h"
+
+ThreadPool::ThreadPool(int n_threads) : job(nullptr), job_size(0), next_index(0), busy_workers(0), generation(0), stopping(false)
+{
+    //The calling thread also works, so it only needs n - 1 helpers.
+    for(int i = 0; i < n_threads - 1; i++)
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    start_cv.notify_all();
+
+    for(auto &worker: workers)
+        worker.join();
+}
+
+int ThreadPool::size() const
+{
+    return workers.size() + 1;
+}
+
+void ThreadPool::runJob(int worker)
+{
+    int index;
+    while((index = next_index.fetch_add(1)) < job_size)
+        (*job)(index, worker);
+}
+
+void ThreadPool::workerLoop(int worker)
+{
+    long seen_generation = 0;
+
+    while(true){
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_cv.wait(lock, [&]{ return stopping || generation != seen_generation; });
+            if(stopping) return;
+            seen_generation = generation;
+        }
+
+        //Published before the job is marked done, so the caller sees it once parallelFor returns.
+        const long allocations = AllocationTracker::threadAllocations();
+        runJob(worker);
+        AllocationTracker::addWorkerAllocations(AllocationTracker::threadAllocations() - allocations);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(--busy_workers == 0) done_cv.notify_one();
+        }
+    }
+}
+
+void ThreadPool::parallelFor(int n, const std::function<void(int, int)> &fn)
+{
+    if(workers.empty()){
+        for(int i = 0; i < n; i++) fn(i, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &fn;
+        job_size = n;
+        next_index = 0;
+        busy_workers = workers.size();
+        generation++;
+    }
+    start_cv.notify_all();
+
+    runJob(workers.size());
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cv.wait(lock, [&]{ return busy_workers == 0; });
+    job = nullptr;
+}
@@ -0,0 +1,43 @@
+#ifndef DoublePENDULUM_THREADPOOL_H
+#define DoublePENDULUM_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that stay alive between control ticks, so
+// splitting work across cores does not pay a thread creation per solve.
+class ThreadPool
+{
+private:
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable start_cv;
+    std::condition_variable done_cv;
+
+    const std::function<void(int, int)> *job;
+    int job_size;
+    std::atomic<int> next_index;
+    int busy_workers;
+    long generation;
+    bool stopping;
+
+    void workerLoop(int worker);
+    void runJob(int worker);
+
+public:
+    explicit ThreadPool(int n_threads);
+    ~ThreadPool();
+
+    // Runs fn(index, worker) for every index in [0, n). The calling thread takes part
+    // as the last worker, so worker ids go from 0 to size() - 1. Blocks until done.
+    void parallelFor(int n, const std::function<void(int, int)> &fn);
+
+    int size() const;
+};
+
+#endif
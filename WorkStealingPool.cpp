@@ -0,0 +1,126 @@
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+
+WorkStealingPool::WorkStealingPool(int n_threads) : pending(0), submitted(0), stopping(false), next_queue(0)
+{
+    n_threads = std::max(n_threads, 1);
+
+    for(int i = 0; i < n_threads; i++)
+        queues.emplace_back(new Queue());
+
+    for(int i = 0; i < n_threads; i++)
+        workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    sleep_cv.notify_all();
+
+    for(auto &worker: workers)
+        worker.join();
+}
+
+int WorkStealingPool::size() const
+{
+    return workers.size();
+}
+
+//std heaps are max-heaps, so the "largest" task is the one with the earliest deadline.
+bool WorkStealingPool::laterDeadline(const Task &a, const Task &b)
+{
+    return a.deadline > b.deadline;
+}
+
+void WorkStealingPool::submit(Deadline deadline, std::function<void()> task, int worker)
+{
+    if(worker < 0) worker = next_queue++ % queues.size();
+    Queue &queue = *queues[worker % queues.size()];
+
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.heap.push_back({deadline, std::move(task)});
+        std::push_heap(queue.heap.begin(), queue.heap.end(), laterDeadline);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        pending++;
+        submitted++;
+    }
+    sleep_cv.notify_all();
+}
+
+bool WorkStealingPool::popLocal(int worker, Task &task)
+{
+    Queue &queue = *queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if(queue.heap.empty()) return false;
+
+    std::pop_heap(queue.heap.begin(), queue.heap.end(), laterDeadline);
+    task = std::move(queue.heap.back());
+    queue.heap.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::steal(int worker, Task &task)
+{
+    //Look for the victim with the most urgent task, then take it if it is still there.
+    for(int attempt = 0; attempt < 2; attempt++)
+    {
+        int victim = -1;
+        Deadline earliest = Deadline::max();
+
+        for(int i = 0; i < (int)queues.size(); i++){
+            if(i == worker) continue;
+            std::lock_guard<std::mutex> lock(queues[i]->mutex);
+            if(!queues[i]->heap.empty() && queues[i]->heap.front().deadline < earliest){
+                earliest = queues[i]->heap.front().deadline;
+                victim = i;
+            }
+        }
+
+        if(victim < 0) return false;
+        if(popLocal(victim, task)) return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::workerLoop(int worker)
+{
+    Task task;
+
+    while(true)
+    {
+        long seen_submitted;
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            seen_submitted = submitted;
+        }
+
+        if(popLocal(worker, task) || steal(worker, task))
+        {
+            task.run();
+            task.run = nullptr;
+
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            if(--pending == 0) idle_cv.notify_all();
+            continue;
+        }
+
+        //Sleep until something is submitted after the queues were found empty.
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        sleep_cv.wait(lock, [&]{ return stopping || submitted != seen_submitted; });
+        if(stopping) return;
+    }
+}
+
+void WorkStealingPool::waitIdle()
+{
+    std::unique_lock<std::mutex> lock(sleep_mutex);
+    idle_cv.wait(lock, [&]{ return pending == 0; });
+}
@@ -0,0 +1,64 @@
+#ifndef DoublePENDULUM_WORKSTEALINGPOOL_H
+#define DoublePENDULUM_WORKSTEALINGPOOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Pool of workers for independent tasks with deadlines. Every worker keeps its own
+// earliest-deadline-first queue, and an idle worker steals the most urgent task of the
+// others, so tasks stay on the core that ran them before unless another one is free.
+class WorkStealingPool
+{
+public:
+    typedef std::chrono::steady_clock::time_point Deadline;
+
+private:
+    struct Task
+    {
+        Deadline deadline;
+        std::function<void()> run;
+    };
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::vector<Task> heap;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+    std::condition_variable idle_cv;
+    std::atomic<int> pending;
+    long submitted;
+    std::atomic<bool> stopping;
+    std::atomic<unsigned> next_queue;
+
+    static bool laterDeadline(const Task &a, const Task &b);
+
+    bool popLocal(int worker, Task &task);
+    bool steal(int worker, Task &task);
+    void workerLoop(int worker);
+
+public:
+    explicit WorkStealingPool(int n_threads);
+    ~WorkStealingPool();
+
+    // Queues the task on the given worker, or round robin if worker is -1.
+    void submit(Deadline deadline, std::function<void()> task, int worker = -1);
+
+    // Blocks until every submitted task has finished.
+    void waitIdle();
+
+    int size() const;
+};
+
+#endif
@@ -0,0 +1,234 @@
+#include "ActuationModelDoublePendulum.h"
+#include "CostModelDoublePendulum.h"
+#include "PendulumProblem.h"
+#include "SolverMPPI.h"
+#include "SolverCondensedQP.h"
+
+#include "crocoddyl/core/solvers/box-fddp.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+// Planar chain of revolute joints hanging from the base, every link equal.
+static pinocchio::Model buildChain(int n_joints, double link_length, double link_mass)
+{
+    pinocchio::Model model;
+    pinocchio::JointIndex parent = 0;
+
+    for(int i = 0; i < n_joints; i++)
+    {
+        pinocchio::SE3 placement = pinocchio::SE3::Identity();
+        if(i > 0) placement.translation() << 0, 0, link_length;
+
+        parent = model.addJoint(parent, pinocchio::JointModelRX(), placement, "joint" + std::to_string(i + 1));
+
+        pinocchio::Inertia link = pinocchio::Inertia::FromCylinder(link_mass, 0.01, link_length);
+        model.appendBodyToJoint(parent, link.se3Action(pinocchio::SE3(Eigen::Matrix3d::Identity(), Eigen::Vector3d(0, 0, link_length / 2))));
+    }
+    return model;
+}
+
+// Swing up problem of the chain, hanging down with the goal upright. Templated on the
+// scalar so the float and double pipelines solve the same problem.
+template<typename Scalar, int NJoints>
+static boost::shared_ptr<crocoddyl::ShootingProblemTpl<Scalar>> buildChainProblem(const pinocchio::Model &model, int T, double dt)
+{
+    typedef typename crocoddyl::MathBaseTpl<Scalar>::VectorXs VectorXs;
+
+    auto state = boost::make_shared<crocoddyl::StateMultibodyTpl<Scalar>>(boost::make_shared<pinocchio::ModelTpl<Scalar>>(model.cast<Scalar>()));
+    auto actuation = boost::make_shared<ActuationModelPendulumTpl<Scalar, NJoints>>(state, NJoints, NJoints, BOTH_LINKS);
+
+    PendulumCostWeights weights;
+    weights.goal = Eigen::VectorXd::Ones(3 * NJoints);
+    weights.running_goal = 1;
+    weights.terminal_goal = 1e3;
+    weights.x_reg = 0;
+    weights.u_reg = 0;
+    weights.joint_limit = 0;
+
+    const Eigen::VectorXd unbounded = Eigen::VectorXd::Constant(2 * NJoints, std::numeric_limits<double>::max());
+    PendulumCostsTpl<Scalar, NJoints> costs(state, NJoints, weights, -unbounded, unbounded);
+    //The chain regularizes the torque on every node, not only the terminal one.
+    costs.running->addCost("u_reg", costs.u_reg, 1e-3);
+
+    VectorXs u_limit = VectorXs::Constant(NJoints, 5);
+    PendulumModelsTpl<Scalar> models(state, actuation, costs.running, costs.terminal, T, Scalar(dt), -u_limit, u_limit);
+
+    VectorXs x0 = state->zero();
+    x0[0] = Scalar(M_PI);
+
+    return models.createProblem(x0);
+}
+
+template<int NJoints>
+static void benchmarkChain(int T, double dt, int iterations, int repeats)
+{
+    auto problem = buildChainProblem<double, NJoints>(buildChain(NJoints, 0.15, 0.15), T, dt);
+    const auto &state = problem->get_runningModels()[0]->get_state();
+    crocoddyl::SolverBoxFDDP solver(problem);
+
+    double total_time = 0, best_time = 1e100;
+    long total_iterations = 0;
+
+    for(int r = 0; r < repeats; r++)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        solver.solve(crocoddyl::DEFAULT_VECTOR, crocoddyl::DEFAULT_VECTOR, iterations, false, 1e-9);
+        double time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        total_time += time;
+        best_time = std::min(best_time, time);
+        total_iterations += solver.get_iter() + 1;
+    }
+
+    std::cout << NJoints << "\t" << state->get_nx() << "\t" << total_time / repeats << "\t" << best_time
+    << "\t" << total_time / total_iterations << "\t" << solver.get_cost() << std::endl;
+}
+
+// Times an MPPI solve of T nodes from the hanging chain, in the given precision.
+template<typename Scalar>
+static double timeMPPI(SolverMPPITpl<Scalar> &mppi, const std::vector<typename SolverMPPITpl<Scalar>::VectorXs> &init_us,
+                       int iterations, int repeats)
+{
+    double best_time = 1e100;
+    for(int r = 0; r < repeats; r++)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        mppi.solve(init_us, iterations);
+        best_time = std::min(best_time, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+    }
+    return best_time;
+}
+
+//Float against double MPPI on the double pendulum. Both start from the same nominal torques
+//and draw the same samples, so the difference is only the precision. The float solution is
+//checked by evaluating its torques on the double problem.
+static void precisionBenchmark(int T, double dt, int samples, int iterations, int repeats)
+{
+    const pinocchio::Model model = buildChain(2, 0.15, 0.15);
+    auto problem = buildChainProblem<double, 2>(model, T, dt);
+    auto float_problem = buildChainProblem<float, 2>(model, T, dt);
+
+    SolverMPPITpl<double> mppi(problem, samples, 0.5, 1.0, 1, -Eigen::VectorXd::Constant(2, 5), Eigen::VectorXd::Constant(2, 5));
+    SolverMPPITpl<float> float_mppi(float_problem, samples, 0.5f, 1.0f, 1, -Eigen::VectorXf::Constant(2, 5), Eigen::VectorXf::Constant(2, 5));
+
+    std::vector<Eigen::VectorXd> init_us(T - 1, Eigen::VectorXd::Zero(2));
+    std::vector<Eigen::VectorXf> float_init_us(T - 1, Eigen::VectorXf::Zero(2));
+
+    const double time = timeMPPI(mppi, init_us, iterations, repeats);
+    const double float_time = timeMPPI(float_mppi, float_init_us, iterations, repeats);
+
+    //The last repeat of each solver ran on the same samples.
+    std::vector<Eigen::VectorXd> float_us(T - 1);
+    for(int t = 0; t < T - 1; t++) float_us[t] = float_mppi.get_us()[t].cast<double>();
+    std::vector<Eigen::VectorXd> float_xs(T, problem->get_x0());
+    problem->rollout(float_us, float_xs);
+    const double float_cost_in_double = problem->calc(float_xs, float_us);
+
+    std::cout << "Precision benchmark. T: " << T << " dt: " << dt << " samples: " << samples << " iterations: " << iterations << std::endl;
+    std::cout << "precision\tbest ms\tcost" << std::endl;
+    std::cout << "double\t" << time << "\t" << mppi.get_cost() << std::endl;
+    std::cout << "float\t" << float_time << "\t" << float_cost_in_double << " (float: " << float_mppi.get_cost() << ")" << std::endl;
+    std::cout << "speedup: " << time / float_time << " u0 difference: " << (mppi.get_us()[0] - float_us[0]).lpNorm<Eigen::Infinity>()
+    << " Nm, relative cost difference: " << std::abs(float_cost_in_double - mppi.get_cost()) / std::abs(mppi.get_cost()) << std::endl;
+}
+
+//Box-FDDP against the condensed QP on the double pendulum swing up, for every horizon. The cold
+//solve starts from zero torques. The warm solve is an MPC tick: the solution is shifted one node
+//and solved again from a slightly moved x0.
+static void backendsBenchmark(const std::vector<int> &horizons, double dt, int iterations, int repeats)
+{
+    std::cout << "Backends benchmark. dt: " << dt << " iterations: " << iterations << std::endl;
+    std::cout << "T\tbackend\tcold ms\titer\tcost\twarm ms" << std::endl;
+
+    const pinocchio::Model model = buildChain(2, 0.15, 0.15);
+
+    for(int T: horizons)
+    {
+        auto problem = buildChainProblem<double, 2>(model, T, dt);
+        const Eigen::VectorXd x0 = problem->get_x0();
+        Eigen::VectorXd x0_moved = x0;
+        x0_moved[2] += 0.01;
+
+        crocoddyl::SolverBoxFDDP fddp(problem);
+        SolverCondensedQP condensed(problem, 20);
+
+        std::vector<Eigen::VectorXd> zero_us(T - 1, Eigen::VectorXd::Zero(2));
+        std::vector<Eigen::VectorXd> shifted_xs(T), shifted_us(T - 1);
+
+        double cold_time = 1e100, warm_time = 1e100;
+        for(int r = 0; r < repeats; r++)
+        {
+            problem->set_x0(x0);
+            auto start = std::chrono::high_resolution_clock::now();
+            fddp.solve(crocoddyl::DEFAULT_VECTOR, crocoddyl::DEFAULT_VECTOR, iterations, false, 1e-9);
+            cold_time = std::min(cold_time, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+
+            std::fill(std::copy(fddp.get_xs().begin() + 1, fddp.get_xs().end(), shifted_xs.begin()), shifted_xs.end(), fddp.get_xs().back());
+            std::fill(std::copy(fddp.get_us().begin() + 1, fddp.get_us().end(), shifted_us.begin()), shifted_us.end(), fddp.get_us().back());
+            problem->set_x0(x0_moved);
+            start = std::chrono::high_resolution_clock::now();
+            fddp.solve(shifted_xs, shifted_us, iterations, false, 1e-9);
+            warm_time = std::min(warm_time, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+        }
+        problem->set_x0(x0);
+        fddp.solve(crocoddyl::DEFAULT_VECTOR, crocoddyl::DEFAULT_VECTOR, iterations, false, 1e-9);
+        std::cout << T << "\tfddp\t" << cold_time << "\t" << fddp.get_iter() << "\t" << fddp.get_cost() << "\t" << warm_time << std::endl;
+
+        cold_time = 1e100;
+        warm_time = 1e100;
+        for(int r = 0; r < repeats; r++)
+        {
+            problem->set_x0(x0);
+            auto start = std::chrono::high_resolution_clock::now();
+            condensed.solve(zero_us, iterations);
+            cold_time = std::min(cold_time, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+
+            std::fill(std::copy(condensed.get_us().begin() + 1, condensed.get_us().end(), shifted_us.begin()), shifted_us.end(), condensed.get_us().back());
+            problem->set_x0(x0_moved);
+            start = std::chrono::high_resolution_clock::now();
+            condensed.solve(shifted_us, iterations);
+            warm_time = std::min(warm_time, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+        }
+        problem->set_x0(x0);
+        condensed.solve(zero_us, iterations);
+        std::cout << T << "\tcondensed\t" << cold_time << "\t" << condensed.get_iter() << "\t" << condensed.get_cost() << "\t" << warm_time << std::endl;
+    }
+}
+
+static void chainBenchmark(int T, double dt, int iterations, int repeats)
+{
+    std::cout << "Chain benchmark. T: " << T << " dt: " << dt << " iterations: " << iterations << std::endl;
+    std::cout << "joints\tnx\tmean ms\tbest ms\tms/iter\tcost" << std::endl;
+
+    benchmarkChain<2>(T, dt, iterations, repeats);
+    benchmarkChain<3>(T, dt, iterations, repeats);
+    benchmarkChain<4>(T, dt, iterations, repeats);
+    benchmarkChain<5>(T, dt, iterations, repeats);
+}
+
+int main(int argc, char ** argv)
+{
+    std::string benchmark = argc > 1 ? argv[1] : "chain";
+
+    if(benchmark == "chain"){
+        int T = argc > 2 ? std::stoi(argv[2]) : 100;
+        chainBenchmark(T, 0.01, 20, 10);
+    }else if(benchmark == "precision"){
+        int T = argc > 2 ? std::stoi(argv[2]) : 100;
+        precisionBenchmark(T, 0.01, 256, 5, 10);
+    }else if(benchmark == "backends"){
+        std::vector<int> horizons;
+        for(int i = 2; i < argc; i++) horizons.push_back(std::stoi(argv[i]));
+        if(horizons.empty()) horizons = {10, 20, 40, 80, 160};
+        backendsBenchmark(horizons, 0.01, 100, 5);
+    }else{
+        std::cout << "Usage: " << argv[0] << " chain [T] | precision [T] | backends [T...]" << std::endl;
+        return 1;
+    }
+    return 0;
+}
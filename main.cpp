@@ -1,20 +1,33 @@
 #include "Controller.h"
+#include "RigHost.h"
+#include "DataAcquisition.h"
 #include <csignal>
+#include <cstdlib>
 
 
 bool Controller::signalFlag  = false;
 
 void wait_for_key ();
 void recordFreeFall();
+void buildPolicy();
+void runRigs();
+void replaySession();
+int checkAllocations(int ticks, int warmup);
 
 int main(int argc, char ** argv) {
+    if(argc > 1 && std::string(argv[1]) == "check-allocations")
+        return checkAllocations(argc > 2 ? std::atoi(argv[2]) : 1000, 100);
+
     //recordFreeFall();
+    //buildPolicy();
+    //runRigs();
+    //replaySession();
     
     Controller c(
         std::string("/home/adria/TFG/DoublePendulumMPC/DoublePendulumCpp/double_pendulum_description/urdf/double_pendulum_good.urdf"),//Model path
         std::string("/home/adria/TFG/DoublePendulumMPC/config.yaml")); // Configuration path
 
-   // std::signal(SIGINT, c.signalHandler);
+    std::signal(SIGINT, c.signalHandler);
     
     c.connectODrive();
 
@@ -50,183 +63,158 @@ void recordFreeFall() {
     c.connectODrive();
     c.odrive->m0->disable();
     
-    int rec_time = 8;               //In seconds
-    int adquisition_period = 1000;   //In us
-    long loopIterations = (long)((rec_time * 1.0e6) / (double)adquisition_period);
+    double rec_time = 8;                //In seconds
+    double adquisition_period = 1e-3;   //In s
 
     Graph_Logger * graph_logger = new Graph_Logger(1e-4);
-    
-    long i = 0;
-    while(i++ < loopIterations){
-        graph_logger->appendToBuffer("pendulum position",c.odrive->m0->getPosEstimateInRad());
-       // graph_logger->appendToBuffer("testVel",c.odrive->m0->getVelEstimateInRads());
-        
-        if(i % (loopIterations / 10) == 0)
-            std::cout << "Iteration: " << i << std::endl;
-        usleep(adquisition_period);
-    }
-    std::cout << "Data adquisition done! Calculating dt..." << std::endl;
-
-    auto buffer = graph_logger->getBuffer("pendulum position");
-    long buffer_size = buffer.size();
-    double period = -1;
-    
-    std::vector<double> maximums;
-    std::vector<double> minimums;
 
-    std::vector<double> maximums_i;
-    std::vector<double> minimums_i;
-    //int distanceToRefresh = 150;
-    
-    double startingPoint = buffer[0];
-    double max = startingPoint;
-    double min = startingPoint;
-    double val = 0;
-    bool lookingForMin = true;
-    
-    //Method 1
-    for(long i  = 0; i < buffer_size; i++){
-        val = buffer[i];
-        if(lookingForMin){
-            if(val <= min){
-                min = val;
-            }else if(val - 0.01 > min){
-                if(std::find(minimums.begin(), minimums.end(), val) == minimums.end()){
-                    minimums.push_back(min);
-                    minimums_i.push_back(i);
-                }
-                max = min;
-                min = startingPoint;
-                lookingForMin = false;
-            }
-        }else{
-            if(val >= max){
-                max = val;
-            }else if(val + 0.01 <= max){
-                if(std::find(maximums.begin(), maximums.end(), val) == maximums.end()){
-                    maximums.push_back(max);
-                    maximums_i.push_back(i);
-                }
-                min = max;
-                max = minimums[0];
-                lookingForMin = true;
-            }
-        }   
+    // Free swing, no current in any motor. The ODrive wrapper has no measured current reading,
+    // the current channels hold the commanded one the estimator is fed with.
+    c.createParameterEstimator();
+    Eigen::VectorXd x(4);
+    Eigen::VectorXd currents = Eigen::VectorXd::Zero(2);
+
+    DataAcquisition acquisition({"q0", "q1", "v0", "v1", "i0", "i1"}, adquisition_period, (long)(rec_time / adquisition_period));
+    acquisition.detectPeaks(acquisition.channel("q0"), 0.01);
+
+    acquisition.run(rec_time,
+        [&](double *values){
+            c.readState(x);
+            Eigen::Map<Eigen::VectorXd>(values, 4) = x;
+            Eigen::Map<Eigen::VectorXd>(values + 4, 2) = currents;
+        },
+        [&](double t, const double *values){
+            c.updateParameterEstimate(t, x, currents);
+        });
+
+    std::cout << "Data adquisition done!" << std::endl;
+    acquisition.printJitter();
+    c.printIdentifiedParameters();
+
+    //The plots are in ms, put the samples on a 1 ms grid.
+    std::vector<double> position;
+    acquisition.resample(acquisition.channel("q0"), 1e-3, position);
+    for(double p: position)
+        graph_logger->appendToBuffer("pendulum position", p);
+
+    std::vector<double> maximums, maximums_i, minimums, minimums_i;
+    const double t0 = acquisition.time(0);
+    for(auto const& extremum: acquisition.get_peak_detector()->get_extrema()){
+        (extremum.maximum ? maximums : minimums).push_back(extremum.value);
+        (extremum.maximum ? maximums_i : minimums_i).push_back((extremum.t - t0) * 1e3);
     }
-    /*
-    //Method 2
-    int a = 0;
-    for(long i  = 1; i < buffer_size; i++){
-        
-        double dy = buffer[i] / buffer[i-1];
-        std::cout << dy << std::endl;
-        if(std::abs(dy-1) <= 0.00001)
-        {
-            if(a % 2 == 0)
-            {
-                //Minim
-                minimums.push_back(buffer[i]);
-                minimums_i.push_back(i);
-            }
-            else
-            {
-                //Maxim
-                maximums.push_back(buffer[i]);
-                maximums_i.push_back(i);
-            }
-            a++;
-        }
-    }
-    */
-    
-    // std::cout << "Buffer: "<< std::flush;
+    std::cout << "Found " << maximums_i.size() << " maximum and " << minimums_i.size() << " minimum." << std::endl;
 
-    // for(int i = 0; i < 10; i++)
-    //     std::cout << buffer[i] << " " << std::flush;
-    // std::cout << std::endl;
+    std::vector<std::string> datasets = {"pendulum position"};
+    graph_logger->plot("Pendulum Positions", datasets,"ms","rad", false, false);
 
+    graph_logger->drawMaxMinLocations(maximums,maximums_i,minimums,minimums_i);
 
-    // std::cout << "Buffer times: "<< std::flush;
+    const double period = acquisition.get_peak_detector()->get_period();
+    if(period > 0)
+        std::cout << "Calculated freq: "<< 1.0 / period << " dt = " << period * 1e3 << "ms or "<< period << "s" << std::endl;
+    else
+        std::cout << "Not enough oscillations to measure the period." << std::endl;
 
-    // for(int i = 0; i < 10; i++)
-    //     std::cout << i << " " << std::flush;
-    // std::cout << std::endl;
+    wait_for_key();
+}
 
+void buildPolicy() {
+    Controller c(
+        std::string("/home/adria/TFG/DoublePendulumMPC/DoublePendulumCpp/double_pendulum_description/urdf/double_pendulum_good.urdf"),//Model path
+        std::string("/home/adria/TFG/DoublePendulumMPC/config.yaml")); // Configuration path
 
-    // std::cout << "Min points: " << std::flush;
-    // for(int i = 0; i < 10; i++){
-    //     std::cout << minimums[i] << " ";
-    // }
-    // std::cout << std::endl;
-    
-    // std::cout << "Min times: " << std::flush;
-    // for(int i = 0; i < 10; i++){
-    //     std::cout << minimums_i[i] << " ";
-    // }
-    // std::cout << std::endl;
-    
+    c.connectODrive();
 
-    // std::cout << "Max points: " << std::flush;
-    // for(int i = 0; i < maximums.size(); i++){
-    //     std::cout << maximums[i] << " ";
-    // }
-    // std::cout << std::endl;
+    // The policy is sampled around the swing-up trajectory.
+    c.createDOCP(true);
+    c.createTrajectory();
 
-    // std::cout << "Max times: " << std::flush;
-    // for(int i = 0; i < maximums_i.size(); i++){
-    //     std::cout << maximums_i[i] << " ";
-    // }
-    // std::cout << std::endl;
+    c.createDOCP(false);
+    c.buildPolicy(5000, "/home/adria/TFG/DoublePendulumMPC/policy.bin");
+    c.stopMotors();
+}
 
-    std::cout << "Found " << maximums_i.size() << " maximum and " << minimums_i.size() << " minimum." << std::endl;
+void runRigs() {
+    RigHost host(std::string("/home/adria/TFG/DoublePendulumMPC/rigs.yaml"));
 
-        
-    std::vector<std::string> datasets = {"pendulum position"};
-    graph_logger->plot("Pendulum Positions", datasets,"ms","rad", false, false);
-    
-    graph_logger->drawMaxMinLocations(maximums,maximums_i,minimums,minimums_i);
-    
+    host.prepare();
+    host.run();
+    host.printMetrics();
+}
 
-    std::vector<double> dts;
+void replaySession() {
+    Controller c(
+        std::string("/home/adria/TFG/DoublePendulumMPC/DoublePendulumCpp/double_pendulum_description/urdf/double_pendulum_good.urdf"),//Model path
+        std::string("/home/adria/TFG/DoublePendulumMPC/config.yaml")); // Configuration path
 
-    //Elimina l'ultima dada si es imparell.
-    if(maximums_i.size() % 2 != 0){
-        maximums_i.pop_back();
-        maximums.pop_back();
-    }
-    
-    for(int i = 0; i < maximums_i.size(); i++){
-        long x = maximums_i[i];  //0
-        long x1 = maximums_i[i + 1]; // 1
-        dts.push_back(x1 - x);
-    }
+    // No ODrive needed, the recorded states drive the solver.
+    c.createDOCP(false);
+    c.replaySession("/home/adria/TFG/DoublePendulumMPC/session.bin");
+}
 
-    if(minimums_i.size() % 2 != 0){
-        minimums_i.pop_back();
-        minimums.pop_back();
+// Runs the control loop against a simulated pendulum and fails if any tick after the
+// warm-up allocates. Build with DOUBLEPENDULUM_EIGEN_NO_MALLOC to get an assert at the
+// Eigen allocation instead of only the count.
+int checkAllocations(int ticks, int warmup) {
+    if(!AllocationTracker::enabled()){
+        std::cout << "Allocation tracking is off, build with -DDOUBLEPENDULUM_TRACK_ALLOCATIONS=ON." << std::endl;
+        return 1;
     }
 
-    for(int i = 0; i < minimums_i.size(); i++){
-        long x = minimums_i[i];  //0
-        long x1 = minimums_i[i + 1]; // 1
-        dts.push_back(x1 - x);
+    Controller c(
+        std::string("/home/adria/TFG/DoublePendulumMPC/DoublePendulumCpp/double_pendulum_description/urdf/double_pendulum_good.urdf"),//Model path
+        std::string("/home/adria/TFG/DoublePendulumMPC/config.yaml")); // Configuration path
+
+    // Hanging, upright is q = 0.
+    Eigen::VectorXd x0 = Eigen::VectorXd::Zero(4);
+    x0[0] = M_PI;
+    c.connectSimulatedPlant(x0);
+
+    c.createDOCP(true);
+    c.createTrajectory();
+    c.createDOCP(false);
+    c.startControl();
+
+    long allocating_ticks = 0;
+    long first_allocating_tick = -1;
+    long max_allocations = 0;
+
+    int tick = 0;
+    for(; tick < warmup + ticks; tick++)
+    {
+        if(tick == warmup) c.setForbidEigenMalloc(true);
+
+        if(!c.controlTick()){
+            std::cout << "The simulated pendulum left the limits at tick " << tick << std::endl;
+            break;
+        }
+
+        long allocations = c.getTickAllocations();
+        if(tick >= warmup && allocations > 0)
+        {
+            if(first_allocating_tick < 0) first_allocating_tick = tick;
+            allocating_ticks++;
+            max_allocations = std::max(max_allocations, allocations);
+        }
     }
+    c.setForbidEigenMalloc(false);
+    c.printControlSummary();
 
-    std::cout << "Periods: "<< std::flush;
-    for(int i = 0; i < dts.size(); i++){
-        std::cout << dts[i] << " ";
-        if(std::abs(dts[i]) < 1e10)
-            period += dts[i];
+    //A run cut short checked fewer ticks than asked, it can not vouch for the rest.
+    if(tick < warmup + ticks){
+        std::cout << "Only " << std::max(tick - warmup, 0) << " of " << ticks << " ticks ran after " << warmup << " warm-up ticks." << std::endl;
+        return 1;
     }
-    std::cout << std::endl;
-    
 
-    period /= dts.size();
-    period = (period * 1000.0) / 1000.0 ;// ms
+    if(allocating_ticks == 0){
+        std::cout << "No allocations in " << ticks << " ticks after " << warmup << " warm-up ticks." << std::endl;
+        return 0;
+    }
 
-    std::cout << "Calculated freq: "<< 1000.0/(period) << " dt = " << period << "ms or "<< period / 1000.0 << "s" << std::endl;
-    
-    wait_for_key();
+    std::cout << allocating_ticks << " of " << ticks << " ticks allocated, first at tick " << first_allocating_tick
+    << ", at most " << max_allocations << " allocations in one tick." << std::endl;
+    return 1;
 }
 
 void wait_for_key ()
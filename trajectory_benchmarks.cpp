@@ -0,0 +1,240 @@
+#include "pinocchio/parsers/urdf.hpp"
+
+#include "crocoddyl/core/solvers/ddp.hpp"
+#include "crocoddyl/core/solvers/fddp.hpp"
+#include "crocoddyl/core/solvers/box-fddp.hpp"
+
+#include "ActuationModelDoublePendulum.h"
+#include "PendulumProblem.h"
+#include "ConfigWatcher.h"
+#include "AllocationTracker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Offline sweep of the swing up trajectory of Controller::createTrajectory over solver, T_ROUTE,
+// dt, integrator and threads. The problem is the one createDOCP(true) builds from the same URDF
+// and config, every combination is solved from each initial state and the results go out as JSON.
+//
+// The sweep is read from an optional trajectory_benchmark section of the config:
+//   trajectory_benchmark:
+//     solvers: [ddp, fddp, boxfddp]
+//     horizons: [150, 200, 300]
+//     dts: [0.01, 0.005]
+//     integrators: [euler, rk4]
+//     threads: [1, 4]
+//     repeats: 3
+//     initial_states: [[3.14159, 0, 0, 0], [2.9, 0.2, 0, 0]]
+//     success_position_tolerance: 0.1
+//     success_velocity_tolerance: 0.5
+
+struct BenchmarkProblem
+{
+    boost::shared_ptr<crocoddyl::ShootingProblem> problem;
+    Eigen::VectorXd u_lb;
+    Eigen::VectorXd u_ub;
+};
+
+struct BenchmarkResult
+{
+    std::string solver;
+    int T;
+    double dt;
+    std::string integrator;
+    int threads;
+    std::vector<double> initial_state;
+
+    double mean_ms;
+    double best_ms;
+    int iterations;
+    double cost;
+    std::size_t peak_bytes;
+    bool success;
+    double final_position_error;
+    double final_velocity_error;
+};
+
+static std::vector<double> readList(const YAML::Node &node, const std::vector<double> &fallback)
+{
+    return node ? node.as<std::vector<double>>() : fallback;
+}
+
+// The trajectory problem of Controller::createDOCP(true), with the integrator to sweep.
+static BenchmarkProblem buildTrajectoryProblem(const pinocchio::Model &model, const YAML::Node &config, const TunableParameters &parameters,
+                                               int T, double dt, const std::string &integrator)
+{
+    auto state = boost::make_shared<crocoddyl::StateMultibody>(boost::make_shared<pinocchio::Model>(model));
+    auto actuation = boost::make_shared<ActuationModelDoublePendulum>(state, 2, model.nv,
+                                                                       static_cast<actuated_link>(config["actuated_link"].as<int>()));
+    const std::size_t nu = actuation->get_nu();
+
+    BenchmarkProblem result;
+    result.u_lb = Eigen::VectorXd::Constant(nu, parameters.tau_lb);
+    result.u_ub = Eigen::VectorXd::Constant(nu, parameters.tau_ub);
+
+    Eigen::VectorXd state_lb, state_ub;
+    pendulumStateLimits(model, config["max_joint_velocity"].as<double>(25), state_lb, state_ub);
+
+    PendulumCostWeights weights;
+    weights.goal = Eigen::VectorXd(parameters.goal_weights);
+    weights.running_goal = parameters.trajectory_node_weight;
+    weights.terminal_goal = parameters.trajectory_terminal_weight;
+    weights.x_reg = parameters.x_reg_weight;
+    weights.u_reg = parameters.u_reg_weight;
+    weights.joint_limit = parameters.joint_limit_weight;
+    PendulumCostsTpl<double, 2> costs(state, nu, weights, state_lb, state_ub);
+
+    PendulumModelsTpl<double> models(state, actuation, costs.running, costs.terminal, T, dt, result.u_lb, result.u_ub,
+                                     integrator == "rk4" ? RK4_INTEGRATOR : EULER_INTEGRATOR);
+    result.problem = models.createProblem(state->zero());
+    return result;
+}
+
+static boost::shared_ptr<crocoddyl::SolverAbstract> createSolver(const std::string &name, const boost::shared_ptr<crocoddyl::ShootingProblem> &problem)
+{
+    if(name == "ddp") return boost::make_shared<crocoddyl::SolverDDP>(problem);
+    if(name == "fddp") return boost::make_shared<crocoddyl::SolverFDDP>(problem);
+    if(name == "boxfddp") return boost::make_shared<crocoddyl::SolverBoxFDDP>(problem);
+    return nullptr;
+}
+
+// DDP and FDDP ignore the torque bounds, so the plan is replayed with the torques the motors
+// can give and the swing up counts as done when that rollout ends upright and nearly still.
+static void checkSwingUp(const BenchmarkProblem &benchmark, const std::vector<Eigen::VectorXd> &us,
+                         double &position_error, double &velocity_error)
+{
+    std::vector<Eigen::VectorXd> clamped_us(us.size());
+    for(std::size_t t = 0; t < us.size(); t++)
+        clamped_us[t] = us[t].cwiseMax(benchmark.u_lb).cwiseMin(benchmark.u_ub);
+
+    std::vector<Eigen::VectorXd> xs(us.size() + 1, benchmark.problem->get_x0());
+    benchmark.problem->rollout(clamped_us, xs);
+
+    const Eigen::VectorXd &x = xs.back();
+    const long nq = x.size() / 2;
+    position_error = 0;
+    for(long i = 0; i < nq; i++)
+        position_error = std::max(position_error, std::abs(std::remainder(x[i], 2 * M_PI)));
+    velocity_error = x.tail(nq).lpNorm<Eigen::Infinity>();
+}
+
+//JSON has no inf or nan, a diverged solve writes null.
+static std::string jsonNumber(double value)
+{
+    return std::isfinite(value) ? std::to_string(value) : "null";
+}
+
+static void writeJSON(std::ostream &out, const std::vector<BenchmarkResult> &results)
+{
+    out << "[" << std::endl;
+    for(std::size_t i = 0; i < results.size(); i++)
+    {
+        const BenchmarkResult &r = results[i];
+        out << "  {\"solver\": \"" << r.solver << "\", \"T\": " << r.T << ", \"dt\": " << r.dt
+        << ", \"integrator\": \"" << r.integrator << "\", \"threads\": " << r.threads << ", \"initial_state\": [";
+        for(std::size_t j = 0; j < r.initial_state.size(); j++)
+            out << (j ? ", " : "") << r.initial_state[j];
+        out << "], \"mean_ms\": " << r.mean_ms << ", \"best_ms\": " << r.best_ms << ", \"iterations\": " << r.iterations
+        << ", \"cost\": " << jsonNumber(r.cost) << ", \"peak_bytes\": " << r.peak_bytes << ", \"success\": " << (r.success ? "true" : "false")
+        << ", \"final_position_error\": " << jsonNumber(r.final_position_error)
+        << ", \"final_velocity_error\": " << jsonNumber(r.final_velocity_error)
+        << "}" << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    out << "]" << std::endl;
+}
+
+int main(int argc, char ** argv)
+{
+    if(argc < 3){
+        std::cout << "Usage: " << argv[0] << " <urdf> <config.yaml> [results.json]" << std::endl;
+        return 1;
+    }
+
+    pinocchio::Model model;
+    pinocchio::urdf::buildModel(argv[1], model);
+
+    const YAML::Node config = YAML::LoadFile(argv[2]);
+    const TunableParameters parameters = TunableParameters::fromYAML(config);
+    const YAML::Node sweep = config["trajectory_benchmark"];
+    const YAML::Node none;
+
+    const std::vector<std::string> solvers = sweep && sweep["solvers"] ? sweep["solvers"].as<std::vector<std::string>>()
+                                                                       : std::vector<std::string>{"ddp", "fddp", "boxfddp"};
+    const std::vector<std::string> integrators = sweep && sweep["integrators"] ? sweep["integrators"].as<std::vector<std::string>>()
+                                                                               : std::vector<std::string>{"euler", "rk4"};
+    const std::vector<double> horizons = readList(sweep ? sweep["horizons"] : none, {config["T_ROUTE"].as<double>()});
+    const std::vector<double> dts = readList(sweep ? sweep["dts"] : none, {config["dt"].as<double>()});
+    const std::vector<double> threads = readList(sweep ? sweep["threads"] : none, {1});
+    const int repeats = sweep ? sweep["repeats"].as<int>(3) : 3;
+    const double position_tolerance = sweep ? sweep["success_position_tolerance"].as<double>(0.1) : 0.1;
+    const double velocity_tolerance = sweep ? sweep["success_velocity_tolerance"].as<double>(0.5) : 0.5;
+
+    //Hanging down at rest, plus a few starts the motors could leave it in.
+    std::vector<std::vector<double>> initial_states = {{M_PI, 0, 0, 0}, {M_PI - 0.2, 0.2, 0, 0}, {M_PI + 0.2, -0.2, 0, 0}, {M_PI, 0, 1, 0}};
+    if(sweep && sweep["initial_states"])
+        initial_states = sweep["initial_states"].as<std::vector<std::vector<double>>>();
+
+    std::vector<BenchmarkResult> results;
+
+    for(double T: horizons)
+    for(double dt: dts)
+    for(auto const& integrator: integrators)
+    for(double n_threads: threads)
+    for(auto const& solver_name: solvers)
+    {
+        //The peak counts the problem and the solver workspace too, they are part of generating a trajectory.
+        const std::size_t live_before = AllocationTracker::liveBytes();
+
+        BenchmarkProblem benchmark = buildTrajectoryProblem(model, config, parameters, (int)T, dt, integrator);
+        benchmark.problem->set_nthreads((int)n_threads);
+        boost::shared_ptr<crocoddyl::SolverAbstract> solver = createSolver(solver_name, benchmark.problem);
+        if(!solver){
+            std::cout << "Unknown solver " << solver_name << ", skipped." << std::endl;
+            continue;
+        }
+
+        for(auto const& initial_state: initial_states)
+        {
+            //Every initial state reports its own peak, not the largest of the ones before it.
+            AllocationTracker::resetPeak();
+            benchmark.problem->set_x0(Eigen::Map<const Eigen::VectorXd>(initial_state.data(), initial_state.size()));
+
+            BenchmarkResult result = {solver_name, (int)T, dt, integrator, (int)n_threads, initial_state};
+            double total_time = 0;
+            result.best_ms = 1e100;
+            for(int r = 0; r < repeats; r++)
+            {
+                auto start = std::chrono::high_resolution_clock::now();
+                solver->solve(crocoddyl::DEFAULT_VECTOR, crocoddyl::DEFAULT_VECTOR, parameters.trajectory_solver_iterations, false, 1e-9);
+                const double time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+                total_time += time;
+                result.best_ms = std::min(result.best_ms, time);
+            }
+            result.mean_ms = total_time / repeats;
+            result.iterations = solver->get_iter() + 1;
+            result.cost = solver->get_cost();
+            result.peak_bytes = AllocationTracker::peakBytes() - live_before;
+
+            checkSwingUp(benchmark, solver->get_us(), result.final_position_error, result.final_velocity_error);
+            result.success = result.final_position_error < position_tolerance && result.final_velocity_error < velocity_tolerance;
+
+            std::cout << solver_name << "\tT " << T << "\tdt " << dt << "\t" << integrator << "\t" << n_threads << " threads\t"
+            << result.mean_ms << " ms\t" << result.iterations << " iter\tcost " << result.cost << "\t" << (result.success ? "ok" : "failed") << std::endl;
+            results.push_back(result);
+        }
+    }
+
+    if(argc > 3){
+        std::ofstream file(argv[3]);
+        writeJSON(file, results);
+        std::cout << "Results written to " << argv[3] << std::endl;
+    }else{
+        writeJSON(std::cout, results);
+    }
+    return 0;
+}